@@ -0,0 +1,81 @@
+
+#ifndef _LOCKFREEQUEUE_H_
+#define _LOCKFREEQUEUE_H_
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// bounded multi-producer / multi-consumer queue of fixed size items
+// (Dmitry Vyukov's sequence-per-cell ring). push and pop never lock or
+// allocate, so either end can be used from the audio thread.
+template <typename T>
+class LockFreeQueue {
+public:
+
+  //capacity is rounded up to a power of two
+  LockFreeQueue( unsigned int capacity ){
+    unsigned int size = 2;
+    while( size < capacity ) size <<= 1;
+    mask = size - 1;
+    cells = new Cell[size];
+    for( unsigned int i=0; i < size; i++) cells[i].sequence.set(i);
+    enqueuePos.set(0);
+    dequeuePos.set(0);
+  }
+
+  ~LockFreeQueue(){ delete[] cells; }
+
+  unsigned int capacity() const { return mask + 1; }
+
+  //returns false if the queue is full
+  bool push( const T& item ){
+    Cell *cell;
+    unsigned int pos = enqueuePos.get();
+    for(;;){
+      cell = &cells[pos & mask];
+      int diff = (int)(cell->sequence.get() - pos);
+      if( diff == 0 ){
+        if( enqueuePos.compareAndSetBool( pos+1, pos ) ) break;
+      }else if( diff < 0 ) return false;
+      else pos = enqueuePos.get();
+    }
+    cell->data = item;
+    cell->sequence.set( pos+1 );
+    return true;
+  }
+
+  //returns false if the queue is empty
+  bool pop( T& item ){
+    Cell *cell;
+    unsigned int pos = dequeuePos.get();
+    for(;;){
+      cell = &cells[pos & mask];
+      int diff = (int)(cell->sequence.get() - (pos+1));
+      if( diff == 0 ){
+        if( dequeuePos.compareAndSetBool( pos+1, pos ) ) break;
+      }else if( diff < 0 ) return false;
+      else pos = dequeuePos.get();
+    }
+    item = cell->data;
+    cell->sequence.set( pos + mask + 1 );
+    return true;
+  }
+
+private:
+  struct Cell {
+    Atomic<unsigned int> sequence;
+    T data;
+  };
+
+  Cell *cells;
+  unsigned int mask;
+  char pad0[64];
+  Atomic<unsigned int> enqueuePos;
+  char pad1[64];
+  Atomic<unsigned int> dequeuePos;
+  char pad2[64];
+
+  LockFreeQueue( const LockFreeQueue& );
+  LockFreeQueue& operator=( const LockFreeQueue& );
+};
+
+#endif
@@ -2,181 +2,543 @@
 #include <assert.h>
 #include <math.h>
 
-#include "sndfile.h"
-
 #include "LoopBuffer.h"
+#include "LoopKernels.h"
+#include "LoopStretcher.h"
+
+LoopBuffer::LoopBuffer() : pool(0), numChannels(1), numTables(0), numChunks(0), maxChunks(0),
+  oldest(0), depth(1), current(0), historyChunks(0), historyLimit( LOOP_UNDO_MB * (1024 * 1024 / LOOP_CHUNK_BYTES) ),
+  liveSlot(0), versions(0), pinned(-1), pinnedSlot(-1), pinnedSize(0), pinnedChannels(0),
+  maxSize(0), curSize(0), wPos(0), rPos(0), rFrac(0), rMin(0), rMax(0), times(0) {
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) chunks[c] = 0;
+  for( unsigned int l=0; l < LOOP_UNDO_LEVELS; l++){
+    for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) layers[l].chunks[c] = 0;
+    layers[l].touched = 0;
+    layers[l].numTouched = 0;
+    layers[l].folds = false;
+  }
+}
 
-#define RW_SIZE 4096
+LoopBuffer::~LoopBuffer(){
+  release();
+  for( unsigned int l=0; l < LOOP_UNDO_LEVELS; l++){
+    for( unsigned int c=0; c < numTables.get(); c++) delete[] layers[l].chunks[c];
+    if( layers[l].touched ) delete[] layers[l].touched;
+  }
+  delete[] versions;
+}
 
-LoopBuffer::LoopBuffer() : maxSize(0), curSize(0), wPos(0), rPos(0), rMin(0), rMax(0), samples(0), times(0) {}
-LoopBuffer::LoopBuffer( unsigned int size) : maxSize(size), curSize(0), wPos(0), rPos(0), rMin(0), rMax(0), times(0) {
-  samples = size > 0 ? new float[size] : 0;
+void LoopBuffer::setPool( SamplePool *p ){
+  release();
+  for( unsigned int l=0; l < LOOP_UNDO_LEVELS; l++){
+    for( unsigned int c=0; c < numTables.get(); c++){ delete[] layers[l].chunks[c]; layers[l].chunks[c] = 0; }
+    if( layers[l].touched ) delete[] layers[l].touched;
+    layers[l].touched = 0;
+  }
+  delete[] versions;
+  versions = 0;
+  numTables.set(0);
+  pool = p;
+  maxChunks = pool ? pool->capacity() : 0;
+  //address space only, what gets touched is what the loop uses
+  if( maxChunks > 0 ){
+    for( unsigned int l=0; l < LOOP_UNDO_LEVELS; l++) layers[l].touched = new unsigned int[maxChunks];
+    versions = new Atomic<uint32>[maxChunks];
+  }
+  reserveChannels( numChannels );
+  select();
 }
 
-LoopBuffer::~LoopBuffer(){
-  if( maxSize > 0 ) delete[] samples;
+//tables for every layer of the new channels. the count is published once they
+//are in place, the live tables only change on the audio thread
+void LoopBuffer::reserveChannels( unsigned int n ){
+  if( n > LOOP_MAX_CHANNELS ) n = LOOP_MAX_CHANNELS;
+  if( maxChunks == 0 ) return;
+  const ScopedLock sl( tablesLock );
+  for( unsigned int c = numTables.get(); c < n; c++){
+    for( unsigned int l=0; l < LOOP_UNDO_LEVELS; l++) layers[l].chunks[c] = new float*[maxChunks];
+    Atomic<uint32>::memoryBarrier();
+    numTables.set( c+1 );
+  }
 }
 
-//resize sample buffer
-void LoopBuffer::resize( unsigned int size){
-  if( (!size && !maxSize) || (size < maxSize) ) return;
-  
-  float *b = new float[size];
-  if(maxSize && samples){
-    memcpy( b, samples, maxSize * sizeof(float) );
-    delete[] samples;
-  }
-  maxSize = size; 
-  samples = b;
-}
-
-//append sample
-void LoopBuffer::operator()( float s ){
-  if(curSize+1 > maxSize) resize(2*maxSize);
-  samples[curSize++] = s;
-  rMax++;
-}
-//read sample
-float LoopBuffer::operator()(){
-    if(rPos >= rMax){ 
-        rPos = rMin;
-        times++;
-    }
-  return samples[rPos++];
+//only while empty, chunks are linked per channel so the old ones go back first.
+//audio thread, it picks up tables reserved since the last select
+void LoopBuffer::setChannels( unsigned int n ){
+  select();
+  if( n < 1 ) n = 1;
+  if( n > numTables.get() ) n = numTables.get();
+  if( n == numChannels || n == 0 ) return;
+  release();
+  numChannels = n;
 }
-  
-//write sample data, appended to buffer
-void LoopBuffer::append( float *in, unsigned int numSamples ){
-  if( !maxSize ) return;
-  else if( curSize + numSamples >= maxSize ) resize(2*maxSize);
-  for( int i=0; i<numSamples; i++)
-    samples[curSize+i] = in[i];
-  if( rMax == curSize ) rMax += numSamples;
-  curSize += numSamples;
+
+//point the live tables at the current layer
+void LoopBuffer::select(){
+  liveSlot = slot(current);
+  LoopLayer& l = layers[ liveSlot ];
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) chunks[c] = l.chunks[c];
 }
 
-//read sample data at r_head, between r_min and r_max
-void LoopBuffer::read( float *out, unsigned int numSamples, float gain=1.f){
-    if( rPos < rMin || rPos >= rMax){ rPos = rMin; times++; }
-  int overlap = rPos + numSamples - rMax;
-  
-  if( overlap >= (int)(rMax-rMin) ) return;
-  if(overlap > 0){
-    int i;
-    for( i = 0; i < numSamples - overlap; i++){
-      out[i] = samples[rPos+i] * gain;
-    }
-    for( int j = 0; j < overlap; j++){
-      out[i++] = samples[rMin+j] * gain;
-    }
-    rPos = overlap;
-      times++;
-    
-  }else{
-    for( int i = 0; i < numSamples; i++){
-      out[i] = samples[rPos+i] * gain;
+void LoopBuffer::peek( unsigned int s ){
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) chunks[c] = layers[s].chunks[c];
+}
+
+bool LoopBuffer::beginLayer(){
+  if( numChunks == 0 || !pool ) return false;
+  if( current + 1 < depth ) dropRedo();
+  //nothing written since the last one
+  if( current > 0 && layers[ slot(current) ].numTouched == 0 ) return false;
+  if( depth == LOOP_UNDO_LEVELS ) dropOldest();
+
+  LoopLayer& from = layers[ slot(current) ];
+  LoopLayer& to = layers[ slot(current+1) ];
+  for( unsigned int c=0; c < numChannels; c++)
+    memcpy( to.chunks[c], from.chunks[c], numChunks * sizeof(float*) );
+  to.numTouched = 0;
+  to.folds = false;
+  depth++;
+  current++;
+  select();
+  return true;
+}
+
+bool LoopBuffer::undo(){
+  if( current == 0 ) return false;
+  current--;
+  select();
+  ++layout;
+  return true;
+}
+
+bool LoopBuffer::redo(){
+  if( current + 1 >= depth ) return false;
+  current++;
+  select();
+  ++layout;
+  return true;
+}
+
+//the oldest layer's chunks that the next one replaced are referenced by no one else
+void LoopBuffer::dropOldest(){
+  if( current == 0 ) return;
+  if( pinned == 0 ) dropPin();
+  else if( pinned > 0 ) pinned--;
+  LoopLayer& old = layers[ slot(0) ];
+  LoopLayer& next = layers[ slot(1) ];
+  for( unsigned int t=0; t < next.numTouched; t++)
+    for( unsigned int c=0; c < numChannels; c++) pool->release( old.chunks[c][ next.touched[t] ] );
+  historyChunks -= next.numTouched * numChannels;
+  next.numTouched = 0;
+  oldest = slot(1);
+  depth--;
+  current--;
+}
+
+//chunks a redo layer copied exist in it and the redo layers above only
+void LoopBuffer::dropRedo(){
+  while( depth > current + 1 ){
+    LoopLayer& l = layers[ slot(depth-1) ];
+    if( pinned == (int)depth-1 ) dropPin();
+    for( unsigned int t=0; t < l.numTouched; t++)
+      for( unsigned int c=0; c < numChannels; c++) pool->release( l.chunks[c][ l.touched[t] ] );
+    historyChunks -= l.numTouched * numChannels;
+    l.numTouched = 0;
+    depth--;
+  }
+}
+
+void LoopBuffer::forget(){
+  dropRedo();
+  while( current > 0 ) dropOldest();
+}
+
+void LoopBuffer::setHistoryLimit( unsigned int limit ){
+  historyLimit = limit;
+  while( historyChunks > historyLimit && current > 0 ) dropOldest();
+}
+
+//as if the layer had never been begun, while it is still the top one. chunks
+//it copied replace the ones below, which go back to the pool unless a layer
+//further down still has them. the live samples stay where they are
+void LoopBuffer::fold(){
+  if( pinned < 0 || pinned + 1 != (int)current || current + 1 != depth || !layers[ slot(current) ].folds ) return;
+  LoopLayer& top = layers[ slot(current) ];
+  LoopLayer& below = layers[ slot(current-1) ];
+  LoopLayer *under = current > 1 ? &layers[ slot(current-2) ] : 0;
+  for( unsigned int t=0; t < top.numTouched; t++){
+    unsigned int k = top.touched[t];
+    if( under && below.chunks[0][k] == under->chunks[0][k] ) below.touched[ below.numTouched++ ] = k;
+    else{
+      for( unsigned int c=0; c < numChannels; c++) pool->release( below.chunks[c][k] );
+      historyChunks -= numChannels;
     }
-    rPos += numSamples;
+    for( unsigned int c=0; c < numChannels; c++) below.chunks[c][k] = top.chunks[c][k];
   }
+  top.numTouched = 0;
+  top.folds = false;
+  depth--;
+  current--;
+  select();
 }
 
-void LoopBuffer::readR( float *out, unsigned int numSamples, float gain=1.f){
-  
-    if( rPos < rMin || rPos >= rMax){ rPos = rMax; times++; }
-  int underlap = rPos - numSamples - rMin;
-  
-  if( underlap <= -(int)(rMax-rMin) ) return;
-  float *tmp = &samples[rPos];
-  
-  if(underlap < 0){
-    for( int i = 0; i < rPos; i++){
-      out[i] = *(--tmp) * gain;
+//the reader learns the layer once pins has moved
+void LoopBuffer::pin( int layer ){
+  pinned = layer;
+  pinnedSlot = layer >= 0 ? (int)slot(layer) : -1;
+  pinnedSize = curSize;
+  pinnedChannels = numChannels;
+  ++pins;
+}
+
+//the layer below keeps the original, the live layer gets a copy to write into.
+//with the pool dry there is no copy to make, history goes and writes land in place
+void LoopBuffer::copyOnWrite( unsigned int chunk ){
+  LoopLayer& l = layers[ slot(current) ];
+  float *copy[LOOP_MAX_CHANNELS];
+  for( unsigned int c=0; c < numChannels; c++){
+    copy[c] = pool->allocate();
+    if( !copy[c] ){
+      while( c > 0 ) pool->release( copy[--c] );
+      forget();
+      return;
     }
-    tmp = &samples[rMax];
-    for( int i = rPos; i < numSamples; i++){
-      out[i] = *(--tmp) * gain;
+  }
+  for( unsigned int c=0; c < numChannels; c++){
+    memcpy( copy[c], l.chunks[c][chunk], LOOP_CHUNK_BYTES );
+    l.chunks[c][chunk] = copy[c];
+  }
+  l.touched[ l.numTouched++ ] = chunk;
+  historyChunks += numChannels;
+  while( historyChunks > historyLimit && current > 0 ) dropOldest();
+}
+
+//a foreign chunk in the live layer is only ever there at the bottom of the
+//history, every layer above copies it on its first write. so nothing else
+//holds the pool chunk that takes its place
+bool LoopBuffer::adopt( unsigned int chunk, bool copy ){
+  float *fresh[LOOP_MAX_CHANNELS];
+  for( unsigned int c=0; c < numChannels; c++){
+    fresh[c] = pool->allocate();
+    if( !fresh[c] ){
+      while( c > 0 ) pool->release( fresh[--c] );
+      return false;
     }
-    
-    rPos = rMax + underlap;
-      times++;
-    
-  }else{
-    for( int i = 0; i < numSamples; i++){
-      out[i] = *(--tmp) * gain;
+  }
+  for( unsigned int c=0; c < numChannels; c++){
+    if( copy ) memcpy( fresh[c], chunks[c][chunk], LOOP_CHUNK_BYTES );
+    chunks[c][chunk] = fresh[c];
+  }
+  return true;
+}
+
+//link chunks until size samples fit, false if the pool ran dry
+bool LoopBuffer::resize( unsigned int size){
+  if( maxSize < size ) forget(); //layers all have the same length
+  while( maxSize < size ){
+    if( numChunks >= maxChunks ) return false;
+    for( unsigned int c=0; c < numChannels; c++){
+      float *p = pool->allocate();
+      if( !p ){
+        //all channels or none
+        while( c > 0 ) pool->release( chunks[--c][numChunks] );
+        return false;
+      }
+      chunks[c][numChunks] = p;
     }
-    rPos -= numSamples;
+    numChunks++;
+    maxSize += LOOP_CHUNK_SIZE;
+  }
+  return true;
+}
+
+void LoopBuffer::release(){
+  dropPin();
+  forget();
+  while( numChunks > 0 ){
+    --numChunks;
+    for( unsigned int c=0; c < numChannels; c++) pool->release( chunks[c][numChunks] );
   }
+  maxSize = curSize = rPos = rMin = rMax = 0;
+  rFrac = 0;
+  ++layout;
+}
   
+//write sample data, appended to buffer
+void LoopBuffer::append( float **in, unsigned int numSamples ){
+  if( curSize + numSamples > maxSize && !resize(curSize + numSamples) )
+    numSamples = maxSize - curSize;
+
+  unsigned int pos = curSize, done = 0;
+  while( numSamples ){
+    unsigned int n = span( pos, numSamples );
+    //recording over mapped chunks swaps in pool ones, only copying what is kept
+    if( !pool->owns( chunks[0][pos >> LOOP_CHUNK_BITS] ) && !adopt( pos >> LOOP_CHUNK_BITS, (pos & LOOP_CHUNK_MASK) != 0 ) ) break;
+    for( unsigned int c=0; c < numChannels; c++)
+      memcpy( at(c,pos), in[c] + done, n * sizeof(float) );
+    wrote( pos >> LOOP_CHUNK_BITS );
+    done += n; pos += n; numSamples -= n;
+  }
+  if( rMax == curSize ) rMax = pos;
+  curSize = pos;
+}
+
+//read sample data at r_head, between r_min and r_max
+void LoopBuffer::read( float **out, unsigned int numSamples, float gain=1.f){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  rFrac = 0;
+  if( rPos < rMin || rPos >= rMax){ rPos = rMin; times++; }
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = span( rPos, jmin( numSamples, rMax - rPos ) );
+    for( unsigned int c=0; c < numChannels; c++)
+      k.copyGain( out[c] + done, at(c,rPos), gain, n );
+    done += n; numSamples -= n; rPos += n;
+    if( rPos >= rMax ){ rPos = rMin; times++; }
+  }
+}
+
+void LoopBuffer::readR( float **out, unsigned int numSamples, float gain=1.f){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  rFrac = 0;
+  if( rPos <= rMin || rPos > rMax){ rPos = rMax; times++; }
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = spanR( rPos, jmin( numSamples, rPos - rMin ) );
+    for( unsigned int c=0; c < numChannels; c++)
+      k.copyGainR( out[c] + done, at(c,rPos-1), gain, n );
+    done += n; numSamples -= n; rPos -= n;
+    if( rPos <= rMin ){ rPos = rMax; times++; }
+  }
+}
+
+void LoopBuffer::overdub( float **out, float **in, unsigned int numSamples, float gain, float decay ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  rFrac = 0;
+  if( rPos < rMin || rPos >= rMax){ rPos = rMin; times++; }
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = span( rPos, jmin( numSamples, rMax - rPos ) );
+    if( writable( rPos >> LOOP_CHUNK_BITS ) ){
+      for( unsigned int c=0; c < numChannels; c++)
+        k.overdub( out[c] + done, at(c,rPos), in[c] + done, gain, decay, n );
+      wrote( rPos >> LOOP_CHUNK_BITS );
+    }else
+      for( unsigned int c=0; c < numChannels; c++) k.copyGain( out[c] + done, at(c,rPos), gain, n );
+    done += n; numSamples -= n; rPos += n;
+    if( rPos >= rMax ){ rPos = rMin; times++; }
+  }
 }
 
-void LoopBuffer::addFrom( float *from, unsigned int numSamples, unsigned int offset=0 ){
+void LoopBuffer::overdubR( float **out, float **in, unsigned int numSamples, float gain, float decay ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  rFrac = 0;
+  if( rPos <= rMin || rPos > rMax){ rPos = rMax; times++; }
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = spanR( rPos, jmin( numSamples, rPos - rMin ) );
+    if( writable( (rPos-1) >> LOOP_CHUNK_BITS ) ){
+      for( unsigned int c=0; c < numChannels; c++)
+        k.overdubR( out[c] + done, at(c,rPos-1), in[c] + done, gain, decay, n );
+      wrote( (rPos-1) >> LOOP_CHUNK_BITS );
+    }else
+      for( unsigned int c=0; c < numChannels; c++) k.copyGainR( out[c] + done, at(c,rPos-1), gain, n );
+    done += n; numSamples -= n; rPos -= n;
+    if( rPos <= rMin ){ rPos = rMax; times++; }
+  }
+}
+
+//sample index wrapped into [rMin,rMax)
+static inline unsigned int wrapIndex( int64 i, unsigned int rMin, unsigned int rMax ){
+  int64 len = rMax - rMin;
+  int64 j = (i - rMin) % len;
+  if( j < 0 ) j += len;
+  return rMin + (unsigned int)j;
+}
+
+void LoopBuffer::gather( unsigned int c, float *dst, int64 first, unsigned int count ){
+  unsigned int pos = wrapIndex( first, rMin, rMax );
+  while( count ){
+    unsigned int n = span( pos, jmin( count, rMax - pos ) );
+    memcpy( dst, at(c,pos), n * sizeof(float) );
+    dst += n; count -= n; pos += n;
+    if( pos >= rMax ) pos = rMin;
+  }
+}
+
+//dst[i] is sample first - i
+void LoopBuffer::gatherR( unsigned int c, float *dst, int64 first, unsigned int count ){
+  const LoopKernels& k = getLoopKernels();
+  unsigned int pos = wrapIndex( first, rMin, rMax ) + 1;
+  while( count ){
+    unsigned int n = spanR( pos, jmin( count, pos - rMin ) );
+    k.copyGainR( dst, at(c,pos-1), 1.f, n );
+    dst += n; count -= n; pos -= n;
+    if( pos <= rMin ) pos = rMax;
+  }
+}
+
+unsigned int LoopBuffer::scratchSize( unsigned int numSamples ){
+  return (unsigned int)( numSamples * LOOP_MAX_SPEED ) + 2 * LOOP_INTERP_HALO + 4;
+}
+
+static inline uint64 speedStep( double speed ){
+  return (uint64)( jlimit( LOOP_MIN_SPEED, LOOP_MAX_SPEED, speed ) * 4294967296.0 );
+}
+
+unsigned int LoopBuffer::untilWrap( double speed, bool reverse ){
+  if( rMax <= rMin ) return 0;
+  //the integer reads ignore the fraction, and heads out of the bounds start over from the end they enter at
+  uint64 step = speedStep( speed ), frac = speed == 1.0 ? 0 : rFrac;
+  uint64 len = (uint64)(rMax - rMin) << 32, left = len;
+  if( reverse ){
+    if( rPos > rMin && rPos <= rMax && !(rPos == rMax && frac) ) left = ((uint64)(rPos - rMin) << 32) + frac;
+  }else if( rPos >= rMin && rPos < rMax ) left = len - ((uint64)(rPos - rMin) << 32) - frac;
+  uint64 n = (left + step - 1) / step;
+  return n > 0xffffffff ? 0xffffffff : (unsigned int)n;
+}
+
+static void interpolate( const LoopKernels& k, int interpolation, float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  switch( interpolation ){
+    case LoopBuffer::Linear: k.interpLinear( out, src, phase, step, n ); break;
+    case LoopBuffer::Sinc: k.interpSinc( out, src, phase, step, n ); break;
+    default: k.interpHermite( out, src, phase, step, n ); break;
+  }
+}
+
+//each channel's part of the loop is gathered into scratch, wrapped and with the
+//interpolator's halo, then resampled in one go. cost is bounded by LOOP_MAX_SPEED
+void LoopBuffer::resample( float **out, unsigned int numSamples, double speed, int interpolation, float *scratch ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin || numSamples == 0 ) return;
+  if( rPos < rMin || rPos >= rMax){ rPos = rMin; rFrac = 0; times++; }
+
+  uint64 step = speedStep( speed );
+  uint64 phase = ((uint64)LOOP_INTERP_HALO << 32) + rFrac;
+  unsigned int count = (unsigned int)( (phase + (numSamples-1) * step) >> 32 ) + LOOP_INTERP_HALO + 2;
+  for( unsigned int c=0; c < numChannels; c++){
+    gather( c, scratch, (int64)rPos - LOOP_INTERP_HALO, count );
+    interpolate( k, interpolation, out[c], scratch, phase, step, numSamples );
+  }
+
+  //short loops at high speed can go around more than once a block
+  uint64 len = (uint64)(rMax - rMin) << 32;
+  uint64 pos = ((uint64)(rPos - rMin) << 32) + rFrac + numSamples * step;
+  if( pos >= len ){ times += (int)(pos / len); pos %= len; }
+  rPos = rMin + (unsigned int)(pos >> 32);
+  rFrac = (uint32)pos;
+}
+
+//as readR, output i is at rPos - 1 - i*speed
+void LoopBuffer::resampleR( float **out, unsigned int numSamples, double speed, int interpolation, float *scratch ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin || numSamples == 0 ) return;
+  if( rPos <= rMin || rPos > rMax || (rPos == rMax && rFrac) ){ rPos = rMax; rFrac = 0; times++; }
+
+  uint64 step = speedStep( speed );
+  uint64 phase = ((uint64)(LOOP_INTERP_HALO + 1) << 32) - rFrac;
+  unsigned int count = (unsigned int)( (phase + (numSamples-1) * step) >> 32 ) + LOOP_INTERP_HALO + 2;
+  for( unsigned int c=0; c < numChannels; c++){
+    gatherR( c, scratch, (int64)rPos + LOOP_INTERP_HALO, count );
+    interpolate( k, interpolation, out[c], scratch, phase, step, numSamples );
+  }
+
+  uint64 len = (uint64)(rMax - rMin) << 32;
+  uint64 pos = ((uint64)(rPos - rMin) << 32) + rFrac, d = numSamples * step;
+  if( d >= pos ){
+    uint64 over = d - pos;
+    times += 1 + (int)(over / len);
+    pos = len - over % len;
+  }else pos -= d;
+  rPos = rMin + (unsigned int)(pos >> 32);
+  rFrac = (uint32)pos;
+}
+
+void LoopBuffer::addFrom( float **from, unsigned int numSamples, unsigned int offset=0 ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
   if( offset < rMin || offset >= rMax) offset = rMin;
-  int overlap = offset + numSamples - rMax;
-  
-  assert( overlap < (int)(rMax-rMin) );
-  if(overlap > 0){
-    int i;
-    for( i = 0; i < numSamples - overlap; i++){
-      samples[offset+i] += from[i];
-    }
-    for( int j = 0; j < overlap; j++){
-      samples[rMin+j] += from[i++];
-    }
-    
-  }else{
-    for( int i = 0; i < numSamples; i++){
-      samples[offset+i] += from[i];
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = span( offset, jmin( numSamples, rMax - offset ) );
+    if( writable( offset >> LOOP_CHUNK_BITS ) ){
+      for( unsigned int c=0; c < numChannels; c++)
+        k.add( at(c,offset), from[c] + done, n );
+      wrote( offset >> LOOP_CHUNK_BITS );
     }
+    done += n; numSamples -= n; offset += n;
+    if( offset >= rMax ) offset = rMin;
   }
 }
 
-void LoopBuffer::addFromR( float *from, unsigned int numSamples, unsigned int offset=0 ){
-  if( offset < rMin || offset >= rMax) offset = rMax;
-  int underlap = offset - numSamples - rMin;
-  
-  assert( underlap > -(int)(rMax-rMin) );
-  float *tmp = &samples[offset];
-  
-  if(underlap < 0){
-    for( int i = 0; i < rPos; i++){
-      *(--tmp) += from[i];
-    }
-    tmp = &samples[rMax];
-    for( int i = rPos; i < numSamples; i++){
-      *(--tmp) += from[i];
-    }
-  }else{
-    for( int i = 0; i < numSamples; i++){
-      *(--tmp) += from[i];
+void LoopBuffer::addFromR( float **from, unsigned int numSamples, unsigned int offset=0 ){
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  if( offset <= rMin || offset > rMax) offset = rMax;
+
+  unsigned int done = 0;
+  while( numSamples ){
+    unsigned int n = spanR( offset, jmin( numSamples, offset - rMin ) );
+    if( writable( (offset-1) >> LOOP_CHUNK_BITS ) ){
+      for( unsigned int c=0; c < numChannels; c++)
+        k.addR( at(c,offset-1), from[c] + done, n );
+      wrote( (offset-1) >> LOOP_CHUNK_BITS );
     }
+    done += n; numSamples -= n; offset -= n;
+    if( offset <= rMin ) offset = rMax;
   }
 }
 
 void LoopBuffer::applyGain( float gain, unsigned int numSamples, unsigned int offset=0){
-  if( offset < rMin ) offset = rMin;
-  while( numSamples-- ){
-    if(offset >= rMax) offset = rMin;
-    samples[offset++] *= gain;    
+  const LoopKernels& k = getLoopKernels();
+  if( rMax <= rMin ) return;
+  if( offset < rMin || offset >= rMax ) offset = rMin;
+
+  while( numSamples ){
+    unsigned int n = span( offset, jmin( numSamples, rMax - offset ) );
+    if( writable( offset >> LOOP_CHUNK_BITS ) ){
+      for( unsigned int c=0; c < numChannels; c++)
+        k.scale( at(c,offset), gain, n );
+      wrote( offset >> LOOP_CHUNK_BITS );
+    }
+    numSamples -= n; offset += n;
+    if( offset >= rMax ) offset = rMin;
   }
 }
 
 float LoopBuffer::getRMS(unsigned int numSamples, unsigned int offset){
-  if( curSize == 0 ) return 0.f;
+  const LoopKernels& k = getLoopKernels();
+  if( curSize == 0 || rMax <= rMin || numSamples == 0 ) return 0.f;
   double sum = 0.0;
-  if( offset < rMin ) offset = rMin;
-  unsigned int i = numSamples;
-  while( i-- ){
-    if(offset >= rMax) offset = rMin;
-    float s = samples[offset++];
-    sum += s*s;    
+  if( offset < rMin || offset >= rMax ) offset = rMin;
+  unsigned int count = numSamples;
+  while( count ){
+    unsigned int n = span( offset, jmin( count, rMax - offset ) );
+    for( unsigned int c=0; c < numChannels; c++)
+      sum += k.sumSquares( at(c,offset), n );
+    count -= n; offset += n;
+    if( offset >= rMax ) offset = rMin;
   }
   //return sum / numSamples;
-  return (float) sqrt (sum / numSamples); 
+  return (float) sqrt (sum / ((double)numSamples * numChannels)); 
 }
 
 float LoopBuffer::getRMSR(unsigned int numSamples){
-  unsigned int offset = rPos - numSamples;
-  while( offset < 0 ) offset += rMax;
+  if( rMax <= rMin ) return 0.f;
+  unsigned int len = rMax - rMin;
+  if( numSamples > len ) numSamples = len;
+  unsigned int pos = ( rPos < rMin || rPos > rMax ) ? rMin : rPos;
+  //walk back numSamples inside [rMin,rMax), unsigned so no going below zero
+  unsigned int offset = pos - rMin >= numSamples ? pos - numSamples : pos + len - numSamples;
   
   return getRMS(numSamples, offset); 
 }
@@ -193,17 +555,57 @@ void LoopBuffer::setBounds( unsigned int b1, unsigned int b2=0){
  * Loop
 *
 */
+LoopImage::LoopImage( SamplePool *pool_, unsigned int numChannels_, unsigned int sampleRate_ )
+  : pool(pool_), numChannels( jlimit( 1u, (unsigned int)LOOP_MAX_CHANNELS, numChannels_ ) ),
+    numSamples(0), sampleRate(sampleRate_), rMin(0), rMax(0), stream(0) {}
+
+LoopImage::~LoopImage(){
+  for( unsigned int c=0; c < numChannels; c++)
+    for( unsigned int i=0; i < chunks[c].size(); i++) pool->release( chunks[c][i] );
+}
+
+bool LoopImage::resize( unsigned int size ){
+  while( (chunks[0].size() << LOOP_CHUNK_BITS) < size ){
+    for( unsigned int c=0; c < numChannels; c++){
+      float *p = pool->allocate();
+      if( !p ){
+        while( c > 0 ){ pool->release( chunks[--c].back() ); chunks[c].pop_back(); }
+        return false;
+      }
+      chunks[c].push_back( p );
+    }
+  }
+  numSamples = size;
+  return true;
+}
+
+LoopMeter::LoopMeter() : rPos(0), rMin(0), rMax(0), numSamples(0), channels(1), sampleRate(44100), stream(0), layout(0),
+  rms(0.f), peak(0.f), energy(0.f), gain(1.f), pan(.5f), decay(.5f), speed(1.f), stretch(1.f), fitLength(0),
+  interpolation(LoopBuffer::Hermite), flags(0) {}
+
 Loop::Loop(){
   numSamples = 0;
   seconds = 0.f;
   sampleRate = 44100;
-  recording = playing = stacking = undoing = reversing = recOut = false;
+  recording = playing = stacking = undoing = reversing = recOut = late = false;
+  stream = 0;
   gain = 1.0f;
   pan = .5f;
   decay = .5f;
-  rms = 0.f;
-  iobuffer = 0;
+  speed = 1.0;
+  interpolation = LoopBuffer::Hermite;
+  channels = 1;
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) iobuffer[c] = fadeBuffer[c] = 0;
+  resampleBuffer = 0;
+  fadeSlot = -1;
+  pendingLayer = false;
+  stretch = 1.0;
+  fitLength = 0;
+  stretcher = new LoopStretcher();
+  ioSize = 0;
     times = 0;
+  meterSum = 0.0;
+  meterPeak = meterEnergy = meterHold = 0.f;
 }
 
 Loop::Loop(float num_seconds, unsigned int rate=44100){
@@ -211,138 +613,358 @@ Loop::Loop(float num_seconds, unsigned int rate=44100){
   allocate( numSamples );
   seconds = num_seconds;
   sampleRate = rate;
-  recording = playing = stacking = undoing = reversing = recOut = false;
+  recording = playing = stacking = undoing = reversing = recOut = late = false;
+  stream = 0;
   gain = 1.0f;
   pan = .5f;
   decay = .5f;
-  rms = 0.f;
-  iobuffer = 0;
+  speed = 1.0;
+  interpolation = LoopBuffer::Hermite;
+  channels = 1;
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) iobuffer[c] = fadeBuffer[c] = 0;
+  resampleBuffer = 0;
+  fadeSlot = -1;
+  pendingLayer = false;
+  stretch = 1.0;
+  fitLength = 0;
+  stretcher = new LoopStretcher();
+  ioSize = 0;
     times = 0;
+  meterSum = 0.0;
+  meterPeak = meterEnergy = meterHold = 0.f;
 }
 
 Loop::~Loop(){
-  if(iobuffer) delete[] iobuffer;
+  if(iobuffer[0]) delete[] iobuffer[0];
+  if(fadeBuffer[0]) delete[] fadeBuffer[0];
+  if(resampleBuffer) delete[] resampleBuffer;
+  delete stretcher;
+}
+
+void Loop::setPool( SamplePool *pool ){
+  b.setPool(pool);
+}
+
+void Loop::setChannels( unsigned int n ){
+  channels = jlimit( 1u, (unsigned int)LOOP_MAX_CHANNELS, n );
+  if( b.curSize == 0 ) b.setChannels( channels );
+}
+
+//size the scratch buffers for the device block size, not called while the device runs
+void Loop::prepareToPlay( unsigned int rate, unsigned int blockSize ){
+  sampleRate = rate;
+  if( blockSize <= ioSize ) return;
+  if( iobuffer[0] ) delete[] iobuffer[0];
+  iobuffer[0] = new float[ blockSize * LOOP_MAX_CHANNELS ];
+  if( fadeBuffer[0] ) delete[] fadeBuffer[0];
+  fadeBuffer[0] = new float[ blockSize * LOOP_MAX_CHANNELS ];
+  for( unsigned int c=1; c < LOOP_MAX_CHANNELS; c++){
+    iobuffer[c] = iobuffer[0] + c * blockSize;
+    fadeBuffer[c] = fadeBuffer[0] + c * blockSize;
+  }
+  if( resampleBuffer ) delete[] resampleBuffer;
+  resampleBuffer = new float[ LoopBuffer::scratchSize( blockSize ) ];
+  stretcher->prepare( blockSize );
+  ioSize = blockSize;
 }
 
+//reserve storage up front, recording otherwise grows chunk by chunk
 void Loop::allocate( unsigned int n ){
-  b[0].resize(n);
-  b[1].resize(n);
-  numSamples=n;
-  seconds = n * 1.0f / (1.0f * sampleRate);
-  iobuffer = new float[1024]; //TODO should adjust if change in blocksize
+  b.resize(n);
+}
+
+double Loop::stretchRatio(){
+  if( fitLength && b.rMax > b.rMin )
+    return jlimit( LOOP_MIN_STRETCH, LOOP_MAX_STRETCH, (double)fitLength / (b.rMax - b.rMin) );
+  return stretch;
+}
+
+size_t Loop::memoryUsed(){
+  return ((size_t)b.numChunks * b.numChannels + b.historyChunks) * LOOP_CHUNK_BYTES;
 }
 
 void Loop::play(){ playing = true; recording=false; }
-void Loop::play(int times_){ times = times_; playing = true; recording=false; }
+void Loop::play(int times_){ times = times_; b.times = 0; playing = true; recording=false; }
 void Loop::stop(){ playing = false; recording = false; }
-void Loop::rewind(){ b[0].rPos = b[0].rMin; }
+//back to where a pass starts, the end when reversed
+void Loop::rewind(){ b.rPos = reversing ? b.rMax : b.rMin; b.rFrac = 0; }
 
-void Loop::record(){ recording = true; playing = false;}
+void Loop::record(){ recording = true; playing = false; stream = 0; }
 
-void Loop::stack(){ stacking=!stacking; }
+//each pass of stacking is one undo step
+void Loop::stack(){
+  stacking=!stacking;
+  if( stacking ){
+    if( fadeSlot >= 0 ) pendingLayer = true;
+    else b.beginLayer();
+  }
+}
 void Loop::reverse(){ reversing = !reversing; }
+//the next block fades over from the layer that was live. while stacking, the
+//next layer starts on top once that is done; it would drop the redo step faded from
 void Loop::undo(){
-  
+  int from = b.slot( b.current );
+  if( !b.undo() ) return;
+  if( fadeSlot < 0 ) fadeSlot = from;
+  if( stacking ) pendingLayer = true;
+}
+void Loop::redo(){
+  int from = b.slot( b.current );
+  if( !b.redo() ) return;
+  if( fadeSlot < 0 ) fadeSlot = from;
+  if( stacking ) pendingLayer = true;
+}
+
+void Loop::endFade(){
+  fadeSlot = -1;
+  if( pendingLayer ){
+    pendingLayer = false;
+    if( stacking ) b.beginLayer();
+  }
+}
+
+void Loop::setHistoryLimit( unsigned int chunks ){
+  endFade();
+  b.setHistoryLimit( chunks );
+}
+
+//the live layer if nothing writes it. while stacking a layer starts over it,
+//unless a fade is still to start one, and the one below is held; unhold folds
+//it back. nothing is held while recording, the reader asks again
+void Loop::hold(){
+  if( recording || b.curSize == 0 || (stacking && fadeSlot >= 0) ) b.pin( -1 );
+  else if( !stacking ) b.pin( b.current );
+  else{
+    if( b.beginLayer() ) b.layers[ b.slot(b.current) ].folds = true;
+    b.pin( b.current > 0 ? (int)b.current - 1 : -1 );
+  }
+}
+
+//holds leave no undo steps behind, but for a fade reading the layer below
+void Loop::unhold(){
+  if( fadeSlot < 0 ) b.fold();
+  b.unpin();
 }
 void Loop::clear(){
-  b[0].rMin = b[0].rMax = b[0].rPos = b[0].curSize = 0;
+  fadeSlot = -1;
+  pendingLayer = false;
+  b.dropPin();
+  b.forget();
+  b.rMin = b.rMax = b.rPos = b.curSize = 0;
+  b.setChannels( channels );
+  ++b.layout;
+  stream = 0;
+  numSamples = 0;
+  seconds = 0.f;
+}
+
+//the chunk lists are only emptied, their memory stays with the image
+void Loop::load( LoopImage& image ){
+  fadeSlot = -1;
+  pendingLayer = false;
+  b.release();
+  b.setChannels( image.numChannels );
+  unsigned int n = jmin( (unsigned int)image.chunks[0].size(), b.maxChunks );
+  for( unsigned int c=0; c < b.numChannels && n > 0; c++){
+    memcpy( b.chunks[c], &image.chunks[c][0], n * sizeof(float*) );
+    image.chunks[c].erase( image.chunks[c].begin(), image.chunks[c].begin() + n );
+  }
+  b.numChunks = n;
+  b.maxSize = n << LOOP_CHUNK_BITS;
+  b.curSize = b.rMax = jmin( image.numSamples, b.maxSize );
+  b.rMin = b.rPos = 0;
+  b.rFrac = 0;
+  if( image.rMax > image.rMin && image.rMax <= b.curSize ){
+    b.setBounds( image.rMin, image.rMax );
+    b.rPos = b.rMin;
+  }
+  ++b.layout;
+  channels = b.numChannels;
+  numSamples = b.curSize;
+  seconds = (float)numSamples / sampleRate;
+  recording = false;
+  reversing = false;
+  stream = image.stream;
+}
+
+//pieces before this one were whole chunks. layers all have the same length,
+//so history goes
+void Loop::extend( LoopImage& image ){
+  unsigned int n = jmin( (unsigned int)image.chunks[0].size(), b.maxChunks - b.numChunks );
+  if( !stream || image.stream != stream || image.numChannels != b.numChannels || b.curSize != b.maxSize || recording
+      || n < image.chunks[0].size() ){
+    stream = 0;
+    return;
+  }
+  b.forget();
+  for( unsigned int c=0; c < b.numChannels && n > 0; c++){
+    memcpy( b.chunks[c] + b.numChunks, &image.chunks[c][0], n * sizeof(float*) );
+    image.chunks[c].erase( image.chunks[c].begin(), image.chunks[c].begin() + n );
+  }
+  b.numChunks += n;
+  b.maxSize += n << LOOP_CHUNK_BITS;
+  unsigned int size = jmin( b.curSize + image.numSamples, b.maxSize );
+  if( b.rMax == b.curSize ) b.rMax = size;
+  b.curSize = size;
+  numSamples = size;
+  seconds = (float)numSamples / sampleRate;
+}
+
+void Loop::audioIO( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ){
+  //loop channels never reach past the first LOOP_MAX_CHANNELS of either side
+  if( !in ) numIn = 0;
+  if( !out ) numOut = 0;
+  numIn = jmin( numIn, (unsigned int)LOOP_MAX_CHANNELS );
+  numOut = jmin( numOut, (unsigned int)LOOP_MAX_CHANNELS );
+  if( count > ioSize ){
+    //device delivered more than announced, process in scratch sized pieces
+    float *in2[LOOP_MAX_CHANNELS], *out2[LOOP_MAX_CHANNELS];
+    for( unsigned int offset = 0; offset < count && ioSize; offset += ioSize ){
+      for( unsigned int c=0; c < numIn; c++) in2[c] = in[c] + offset;
+      for( unsigned int c=0; c < numOut; c++) out2[c] = out[c] + offset;
+      process( in2, numIn, out2, numOut, jmin( ioSize, count - offset ) );
+    }
+  }else process( in, numIn, out, numOut, count );
+  if( fadeSlot >= 0 ) endFade();
+  publishMeter( count );
+}
+
+//fold this callback into the running meters and hand a snapshot to each reader
+void Loop::publishMeter( unsigned int count ){
+  float mean = count ? (float)(meterSum / ((double)count * b.numChannels)) : 0.f;
+  float c = expf( -(float)count / LOOP_METER_WINDOW );
+  float fall = expf( -(float)count / (LOOP_METER_PEAK_RELEASE * sampleRate) );
+
+  meterEnergy = mean + ( meterEnergy - mean ) * c;
+  meterHold = jmax( meterPeak, meterHold * fall );
+
+  LoopMeter& m = lastMeter;
+  m.energy = meterEnergy;
+  m.rms = sqrtf( meterEnergy );
+  m.peak = meterHold;
+  m.rPos = b.rPos;
+  m.rMin = b.rMin;
+  m.rMax = b.rMax;
+  m.numSamples = numSamples;
+  m.channels = channels;
+  m.sampleRate = sampleRate;
+  m.stream = stream;
+  m.layout = b.layout.get();
+  m.gain = gain;
+  m.pan = pan;
+  m.decay = decay;
+  m.speed = (float)speed;
+  m.stretch = (float)stretch;
+  m.fitLength = fitLength;
+  m.interpolation = interpolation;
+  m.flags = (recording ? LoopMeter::Recording : 0) | (playing ? LoopMeter::Playing : 0)
+          | (stacking ? LoopMeter::Stacking : 0) | (reversing ? LoopMeter::Reversing : 0)
+          | (recOut ? LoopMeter::RecordOutput : 0);
+  for( int i=0; i < LOOP_METER_READERS; i++){
+    meter[i].write() = m;
+    meter[i].publish();
+  }
+
+  meterSum = 0.0;
+  meterPeak = 0.f;
+}
+
+void Loop::playback( float **dst, unsigned int count ){
+  if( speed != 1.0 ){
+    if(reversing) b.resampleR( dst, count, speed, interpolation, resampleBuffer );
+    else b.resample( dst, count, speed, interpolation, resampleBuffer );
+  }else if(reversing) b.readR( dst, count, 1.f );
+  else b.read( dst, count, 1.f );
 }
 
-void Loop::audioIO( float** in, float** out, unsigned int count ){
+//play the block from both layers, from the same position, and blend across it
+void Loop::crossfade( unsigned int count ){
+  unsigned int pos = b.rPos;
+  uint32 frac = b.rFrac;
+  int t = b.times;
+  b.peek( fadeSlot );
+  playback( fadeBuffer, count );
+  b.select();
+  b.rPos = pos; b.rFrac = frac; b.times = t;
+  playback( iobuffer, count );
+
+  float step = 1.f / count;
+  for( unsigned int c=0; c < b.numChannels; c++){
+    float *from = fadeBuffer[c], *to = iobuffer[c];
+    for( unsigned int i=0; i < count; i++) to[i] = from[i] + (to[i] - from[i]) * ((i+1) * step);
+  }
+  endFade();
+}
+
+void Loop::process( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ){
   
-  unsigned int lPos=0;
-  float l = (1.f - pan );
-  float r = pan;
+  const LoopKernels& k = getLoopKernels();
+  //gain goes in with the pan so the meters see the loop itself
+  float l = (1.f - pan ) * gain;
+  float r = pan * gain;
+  unsigned int numChannels = b.numChannels;
+
+  //input for each loop channel, the last device input repeats
+  float *inc[LOOP_MAX_CHANNELS];
+  for( unsigned int c=0; c < numChannels && numIn; c++) inc[c] = in[ jmin( c, numIn-1 ) ];
   
   if(recording){ //fresh loop
 
-    b[0].append( in[0], count );
+    if( numIn ) b.append( inc, count );
+    numSamples = b.curSize;
+    seconds = numSamples * 1.0f / (1.0f * sampleRate);
 		
-  }else if(playing && numSamples > 0){ //playback and stack
+  }else if(playing && numSamples > 0 && b.rMax > b.rMin){ //playback and stack
 		
-    lPos = b[0].rPos;
-		
-    if(reversing){
+    double ratio = stretchRatio();
+    //the last pass of a counted play ends on its sample, the stretcher counts whole frames
+    if( times > 0 && b.times + 1 >= times && ratio == 1.0 )
+      count = jmin( count, b.untilWrap( speed, reversing ) );
+
+    if( ratio != 1.0 ){
       
-      b[0].readR( iobuffer, count, gain );
+      //same pitch, different length, no stacking either
+      stretcher->process( b, iobuffer, count, ratio, reversing );
       
-      if(stacking){	
-	    b[0].applyGain( decay, count, b[0].rPos );
-        b[0].addFromR( in[0], count, lPos );
-      }
+    }else if( fadeSlot >= 0 ){
+      
+      //undo / redo just swapped layers, no stacking for this block
+      crossfade( count );
+      
+    }else if( speed != 1.0 ){
+      
+      //varispeed playback, stacking waits for unit speed
+      playback( iobuffer, count );
+      
+    }else if(reversing){
+      
+      if(stacking && numIn) b.overdubR( iobuffer, inc, count, 1.f, decay );
+      else b.readR( iobuffer, count, 1.f );
 			
     }else {
       
-      b[0].read( iobuffer, count, gain );
-      
-	  if(stacking){
-        b[0].applyGain( decay, count, lPos);
-        b[0].addFrom( in[0], count, lPos );
-	  }			
+      if(stacking && numIn) b.overdub( iobuffer, inc, count, 1.f, decay );
+      else b.read( iobuffer, count, 1.f );
 	}
     
-    //up mix to 2 channels
-    for( int i=0; i < count; i++){
-      out[0][i] += iobuffer[i] * l;
-      out[1][i] += iobuffer[i] * r;
+    //meter while the block is still in cache
+    for( unsigned int c=0; c < numChannels; c++)
+      meterSum += k.meter( iobuffer[c], count, &meterPeak );
+    
+    if( numChannels == 1 && numOut >= 2 ){
+      //up mix to 2 channels
+      k.panMix( out[0], out[1], iobuffer[0], l, r, count );
+    }else{
+      //even channels are left, odd are right
+      for( unsigned int c=0; c < numChannels && numOut; c++)
+        k.mix( out[ c % numOut ], iobuffer[c], (c & 1) ? r : l, count );
     }
       
-    if( times > 0 && b[0].times >= times ){
-        b[0].times = 0; times = 0;
+    if( times > 0 && b.times >= times ){
+        b.times = 0; times = 0;
         stop();
     }
     
   }//end else if(playing)
 
 } 
-/*
-int Loop::load( const char* filename ){
-
-  SNDFILE *file;
-  SF_INFO sfinfo;
-  float buffer[RW_SIZE];
-  sf_count_t read;
-
-  if( !(file = sf_open(filename, SFM_READ, &sfinfo))){
-    //std::cout << "Error loading file " << filename << std::endl;
-    return -1;
-  }
-
-  sampleRate = sfinfo.samplerate;
-  allocate(sfinfo.frames);
-
-  while( (read = sf_readf_float( file, buffer, RW_SIZE/sfinfo.channels )) > 0 ){
-    switch( sfinfo.channels ){
-      case 1: 
-        b[0].append( buffer, read ); break;
-      case 2:
-        //mix to single channel
-        for( int i=0; i < read/2; i++) buffer[i] = (buffer[2*i]+buffer[2*i+1]) / 2.f;
-        b[0].append( buffer, read/2 ); break;
-      default: return -2; break;
-    }
-  }
-  sf_close(file);
-  return 0;
-}
-
-int Loop::save( const char* filename ){
- 
-  SNDFILE *file;
-  SF_INFO sfinfo;
-  sf_count_t writ;
-
-  sfinfo.samplerate = sampleRate;
-  sfinfo.frames = numSamples;
-  sfinfo.channels = 1;
-  sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-
-  if( !(file = sf_open(filename, SFM_WRITE, &sfinfo))){
-    //std::cout << "Error opening file " << filename << std::endl;
-    return -1;
-  }
-
-  writ = sf_writef_float( file, b[0].samples, numSamples );
-  sf_close( file );
-  return 0;
-}*/
@@ -2,40 +2,178 @@
 #ifndef _LOOPBUFFER_H_
 #define _LOOPBUFFER_H_
 
+#include <vector>
+
+#include "SamplePool.h"
+#include "TripleBuffer.h"
+
+//time constant of the rms meter's exponential average in samples, and the peak
+//meter fall time in seconds
+#define LOOP_METER_WINDOW 2048
+#define LOOP_METER_PEAK_RELEASE 0.3f
+//threads reading the meters: the gui, the osc broadcast, session saves and imports
+#define LOOP_METER_READERS 4
+
+//most channels a loop can have
+#define LOOP_MAX_CHANNELS 8
+
+//layers kept per loop, the live one and its undo / redo steps, and the
+//default memory their own chunks may hold
+#define LOOP_UNDO_LEVELS 16
+#define LOOP_UNDO_MB 64
+
+//playback speed range, bounds the samples read per block
+#define LOOP_MIN_SPEED 0.25
+#define LOOP_MAX_SPEED 4.0
+
+class LoopStretcher;
+
+// one state of a loop's storage. neighbouring layers share every chunk but
+// the ones overdubbed in between, touched lists those this layer copied
+struct LoopLayer {
+  float **chunks[LOOP_MAX_CHANNELS];
+  unsigned int *touched;
+  unsigned int numTouched;
+  bool folds; //started by a hold, see LoopBuffer::fold
+};
+
 struct LoopBuffer {
   
-  float *samples;
- 
+  //planar sample storage, per channel a table of fixed size chunks linked in
+  //from the pool. tables are only allocated for channels asked for
+  SamplePool *pool;
+  float **chunks[LOOP_MAX_CHANNELS]; //the live layer's tables
+  unsigned int numChannels; //channels in use
+  //channel tables allocated. grows from control threads under tablesLock, the
+  //audio thread only reads it and picks new tables up in select()
+  Atomic<uint32> numTables;
+  CriticalSection tablesLock;
+  unsigned int numChunks, maxChunks; //per channel
+
+  //undo history, a ring of layers. writes copy a chunk the first time a layer
+  //touches it, undo and redo swap which layer's tables are live
+  LoopLayer layers[LOOP_UNDO_LEVELS];
+  unsigned int oldest, depth, current; //slot of the oldest layer, layers in use, live layer counted from oldest
+  unsigned int historyChunks, historyLimit; //chunks held only by undo / redo layers
+  unsigned int liveSlot; //slot of the layer select() made live, peek leaves it
+
+  //change tracking for readers on other threads. a chunk's version goes up
+  //after every write into it, layout whenever the live chunks change wholesale
+  Atomic<uint32> *versions; //per chunk
+  Atomic<uint32> layout;
+
+  //a layer held still for a reader on another thread, see Looper::snapshot. its
+  //chunks are neither written nor handed back while it is pinned. history that
+  //has to go takes the pin with it. pins goes up with every pin and every loss
+  int pinned; //layer counted from oldest, -1 if none
+  int pinnedSlot; //of the last pin, -1 if it held nothing
+  unsigned int pinnedSize, pinnedChannels;
+  Atomic<uint32> pins;
+  CriticalSection pinLock; //readers take turns
+
   unsigned int maxSize, curSize; //allocated size, samples recorded
   unsigned int rPos, wPos; //read head, write head at last read
+  uint32 rFrac; //read head position past rPos, 32 bit fraction of a sample
   unsigned int rMin, rMax; //read limiters
     int times;
 
+  enum Interpolation { Linear, Hermite, Sinc };
+
   LoopBuffer();
-  LoopBuffer( unsigned int size);
   ~LoopBuffer();
 
-  //resize sample buffer, default doubles current buffer size
-  void resize( unsigned int size);
+  //take storage from pool, allocates the table for the first channel
+  void setPool( SamplePool *p );
+  //allocate chunk tables for n channels, any thread but the audio thread
+  void reserveChannels( unsigned int n );
+  //drop all samples and switch to n channels, tables must be reserved
+  void setChannels( unsigned int n );
+
+  //start a new undo layer, later writes copy the chunks they touch first. false
+  //if none was needed
+  bool beginLayer();
+  //swap to the layer before / after, false if there is none
+  bool undo();
+  bool redo();
+  //drop every layer but the live one
+  void forget();
+  //cap the chunks held by history, oldest layers are dropped to stay under
+  void setHistoryLimit( unsigned int chunks );
+  //hold a layer for a reader, -1 for none, and let go of it. audio thread
+  void pin( int layer );
+  void unpin(){ pinned = -1; }
+  //fold the live layer into the pinned one below it if a hold started it
+  void fold();
+  //the pinned layer is about to change, the reader has to start over
+  inline void dropPin(){ if( pinned >= 0 ){ pinned = -1; ++pins; } }
 
-  //append sample
-  void operator()( float s );
-  //read one sample
-  float operator()();
+  //grow storage of every channel to at least size samples by linking chunks, never copies
+  bool resize( unsigned int size);
+  //return all chunks to the pool
+  void release();
+
+  inline unsigned int slot( unsigned int layer ){ return (oldest + layer) % LOOP_UNDO_LEVELS; }
+  //call before writing into a chunk, copies it if the layer below still shares it.
+  //chunks not from the pool are mapped read only and get a pool copy too. false
+  //if that could not be made, the chunk must not be written then
+  inline bool writable( unsigned int chunk ){
+    if( pinned == (int)current ) dropPin();
+    if( current + 1 < depth ) dropRedo();
+    if( current > 0 && chunks[0][chunk] == layers[ slot(current-1) ].chunks[0][chunk] ) copyOnWrite( chunk );
+    return pool->owns( chunks[0][chunk] ) || adopt( chunk, true );
+  }
+  //call once a chunk has been written
+  inline void wrote( unsigned int chunk ){ ++versions[chunk]; }
+  void copyOnWrite( unsigned int chunk );
+  bool adopt( unsigned int chunk, bool copy );
+  void dropOldest();
+  void dropRedo();
+  void select();
+  //make a layer's tables live for reading, select() goes back to the current one
+  void peek( unsigned int slot );
+
+  //address of sample i of channel c
+  inline float* at( unsigned int c, unsigned int i ){ return chunks[c][i >> LOOP_CHUNK_BITS] + (i & LOOP_CHUNK_MASK); }
+  //contiguous samples starting at i, forward and backward (ending at i-1)
+  inline unsigned int span( unsigned int i, unsigned int n ){
+    unsigned int left = LOOP_CHUNK_SIZE - (i & LOOP_CHUNK_MASK);
+    return n < left ? n : left;
+  }
+  inline unsigned int spanR( unsigned int i, unsigned int n ){
+    unsigned int left = ((i-1) & LOOP_CHUNK_MASK) + 1;
+    return n < left ? n : left;
+  }
+
+  //all sample data arguments below are numChannels planar buffers
   
   //write sample data, appended to buffer
-  void append( float *in, unsigned int numSamples );
+  void append( float **in, unsigned int numSamples );
 
   //read sample data at r_head, between r_min and r_max
-  void read( float *out, unsigned int numSamples, float gain );
-  void readR( float *out, unsigned int numSamples, float gain );
+  void read( float **out, unsigned int numSamples, float gain );
+  void readR( float **out, unsigned int numSamples, float gain );
+  //read at r_head and overdub in the same pass: out = s*gain, s = s*decay + in
+  void overdub( float **out, float **in, unsigned int numSamples, float gain, float decay );
+  void overdubR( float **out, float **in, unsigned int numSamples, float gain, float decay );
+  
+  //read at r_head moving speed samples per output, interpolated. the integer
+  //reads above drop the fraction. scratch holds scratchSize(numSamples) floats
+  void resample( float **out, unsigned int numSamples, double speed, int interpolation, float *scratch );
+  void resampleR( float **out, unsigned int numSamples, double speed, int interpolation, float *scratch );
+  static unsigned int scratchSize( unsigned int numSamples );
+  //outputs until the read head next wraps and counts in times, at speed and
+  //the direction given. 1 is the integer reads, anything else resample
+  unsigned int untilWrap( double speed, bool reverse );
+  //count samples from first on, forward or backward, wrapping between r_min and r_max
+  void gather( unsigned int c, float *dst, int64 first, unsigned int count );
+  void gatherR( unsigned int c, float *dst, int64 first, unsigned int count );
   
-  void addFrom( float *from, unsigned int numSamples, unsigned int offset );
-  void addFromR( float *from, unsigned int numSamples, unsigned int offset );
+  void addFrom( float **from, unsigned int numSamples, unsigned int offset );
+  void addFromR( float **from, unsigned int numSamples, unsigned int offset );
   
   void applyGain( float gain, unsigned int numSamples, unsigned int offset );
   
-  //get root mean square of numSamples starting at offset
+  //get root mean square over all channels of numSamples starting at offset
   float getRMS( unsigned int numSamples, unsigned int offset);
   //get root mean square of numSamples ago
   float getRMSR( unsigned int numSamples);
@@ -46,24 +184,93 @@ struct LoopBuffer {
 };
 
 
+// samples for a whole loop put together off the audio thread, in pool chunks
+// laid out the way LoopBuffer links them. Loop::load takes the chunks over in
+// one go, any it did not take go back to the pool with the image. a loop
+// arriving in pieces comes as a load of the first and extends of the rest
+struct LoopImage {
+  SamplePool *pool;
+  unsigned int numChannels, numSamples, sampleRate;
+  unsigned int rMin, rMax; //bounds to play, all of it if rMax is 0
+  uint32 stream; //the pieces of one loop share it, 0 for a whole one
+  std::vector<float*> chunks[LOOP_MAX_CHANNELS]; //not all from the pool, see SamplePool::owns
+
+  LoopImage( SamplePool *pool, unsigned int numChannels, unsigned int sampleRate );
+  ~LoopImage();
+
+  //link chunks until size samples per channel fit, false if the pool ran dry
+  bool resize( unsigned int size );
+  inline float* at( unsigned int c, unsigned int i ){ return chunks[c][i >> LOOP_CHUNK_BITS] + (i & LOOP_CHUNK_MASK); }
+};
+
+// what the gui sees of a loop, measured on the audio thread once per
+// callback and handed over through a triple buffer
+struct LoopMeter {
+  enum Flags { Recording = 1, Playing = 2, Stacking = 4, Reversing = 8, RecordOutput = 16 };
+
+  unsigned int rPos, rMin, rMax, numSamples;
+  unsigned int channels, sampleRate; //Loop::channels, and its rate
+  uint32 stream, layout; //Loop::stream, and the buffer's layout
+  float rms; //of what was played, averaged exponentially over about LOOP_METER_WINDOW samples
+  float peak; //held, falls over LOOP_METER_PEAK_RELEASE seconds
+  float energy; //running mean square behind rms
+  float gain, pan, decay, speed;
+  float stretch; //Loop::stretch
+  unsigned int fitLength;
+  int interpolation;
+  int flags;
+
+  LoopMeter();
+};
+
 struct Loop {
   
-  LoopBuffer b[2];
+  LoopBuffer b;
+  unsigned int channels; //channel count, takes effect when the loop is empty
   unsigned int sampleRate;
   unsigned int numSamples;
   float seconds;
-    int times;
+    int times; //passes left of a counted play, 0 plays on
 
-  float gain, pan, decay, rms;
+  float gain, pan, decay;
+  double speed; //overdubbing only happens at 1
+  double stretch; //duration factor at the same pitch, 1 is off, takes over from speed
+  unsigned int fitLength; //if set, stretch the bounds to this many samples instead
+  int interpolation; //LoopBuffer::Interpolation used off unit speed
   bool recording,playing,stacking,reversing,undoing;
     bool recOut;
-  float *iobuffer;
+  Atomic<uint32> turn; //2 * the render pass that took the loop, + 1 until it is rendered. see LoopWorkers
+  bool late; //a render helper still had it this block, its commands wait. audio thread only
+  uint32 stream; //of the image still arriving, 0 once anything else replaces the audio
+  float *iobuffer[LOOP_MAX_CHANNELS]; //planar scratch, one allocation
+  float *resampleBuffer;
+  float *fadeBuffer[LOOP_MAX_CHANNELS]; //planar, the layer faded from after undo / redo
+  int fadeSlot; //that layer's slot, -1 when not fading
+  bool pendingLayer; //start a layer once the fade is done
+  LoopStretcher *stretcher;
+  unsigned int ioSize;
+
+  //one handoff per reading thread, see LOOP_METER_READERS
+  TripleBuffer<LoopMeter> meter[LOOP_METER_READERS];
+  LoopMeter lastMeter; //what they were last handed, audio thread only
+  double meterSum; //sum of squares and peak of the current callback
+  float meterPeak;
+  float meterEnergy, meterHold; //running values, audio thread only
 
   Loop();
   Loop(float num_seconds, unsigned int rate);
   ~Loop();
   
+  void setPool( SamplePool *pool );
+  //channel count for this loop, switched now if nothing is recorded, otherwise
+  //at the next clear. b.reserveChannels(n) has to be done beforehand
+  void setChannels( unsigned int n );
+  void prepareToPlay( unsigned int rate, unsigned int blockSize );
   void allocate( unsigned int n );
+  //stretch factor in use, from fitLength if set
+  double stretchRatio();
+  //bytes of sample memory held by this loop, history included
+  size_t memoryUsed();
   
   void play();
     void play(int times);
@@ -73,11 +280,28 @@ struct Loop {
   void stack();
   void reverse();
   void undo();
+  void redo();
   void clear();
+  //swap all storage for image's, history included, and play it forwards from the
+  //start of its bounds. its channel tables have to be reserved
+  void load( LoopImage& image );
+  //append a further piece of what is being loaded, it plays as far as has
+  //arrived. dropped, and stream reset, if the loop holds something else by now
+  void extend( LoopImage& image );
+  void setHistoryLimit( unsigned int chunks );
+  //pin a layer that stays as it is while a reader copies it, see Looper::snapshot
+  void hold();
+  void unhold();
   
-  void audioIO( float** in, float** out, unsigned int count ); 
-  //int load( const char* filename );
-  //int save( const char* filename );
+  //input channels are mapped onto loop channels, the last one repeated if there
+  //are fewer, loop channels go to outputs round robin with pan as balance
+  void audioIO( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ); 
+  void process( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ); 
+  void publishMeter( unsigned int count );
+  //read only playback at the current speed and direction
+  void playback( float **dst, unsigned int count );
+  void crossfade( unsigned int count );
+  void endFade();
 
 };
 
@@ -20,17 +20,21 @@
 */
 
 //[Headers] You can add your own extra header files here...
+#include "LooperImport.h"
 //[/Headers]
 
 #include "LoopComponent.h"
 
 
 //[MiscUserDefs] You can add your own user definitions and misc code here...
-LoopComponent::LoopComponent ( Loop *loop_, char* c ){
+LoopComponent::LoopComponent ( Looper *looper_, int index_, char* c ){
   setSize(50,50);
   ident = c;
-  loop = loop_;
+  looper = looper_;
+  index = index_;
+  loop = (*looper)(index);
   selected =false;
+  import = 0;
 }
 //[/MiscUserDefs]
 
@@ -47,6 +51,7 @@ LoopComponent::LoopComponent ()
     //[Constructor] You can add your own custom stuff here..
     ident = "0";
   selected=false;
+  import = 0;
     //[/Constructor]
 }
 
@@ -65,19 +70,23 @@ LoopComponent::~LoopComponent()
 void LoopComponent::paint (Graphics& g)
 {
     //[UserPrePaint] Add your own custom painting code here..
-  float rms = loop->rms*20.f;
+  const LoopMeter& m = looper->meter(index);
+  bool recording = (m.flags & LoopMeter::Recording) != 0;
+  bool playing = (m.flags & LoopMeter::Playing) != 0;
+  bool stacking = (m.flags & LoopMeter::Stacking) != 0;
+  float rms = m.rms*20.f;
   if(rms > 1.f ) rms = 1.f;
-  float thick = 2.0f + 5.f*rms*loop->gain;
-  int h = loop->gain * 12;
-  int h2 = (1.f-loop->decay) * 18;
-    int x=10, xpan=loop->pan * 20;
+  float thick = 2.0f + 5.f*rms*m.gain;
+  int h = m.gain * 12;
+  int h2 = (1.f-m.decay) * 18;
+    int x=10, xpan=m.pan * 20;
 
   Colour c,c2,c3;
-  if( loop->numSamples != 0 ){
-    if( loop->stacking ) c = Colour( 165,81,81).withAlpha(rms);
+  if( m.numSamples != 0 ){
+    if( stacking ) c = Colour( 165,81,81).withAlpha(rms);
     else c = Colour( 58,172,62).withAlpha(rms);
 
-    if(loop->recording) c2 = Colour( 200,30,30 ).withAlpha(.8f);
+    if(recording) c2 = Colour( 200,30,30 ).withAlpha(.8f);
     else c2 = Colour( 58,172,62 ).withAlpha(.8f);
 
   }else{
@@ -118,12 +127,12 @@ void LoopComponent::paint (Graphics& g)
     g.setColour (Colour (0xff2a74a5));
     g.fillRect (36, 42-h2, 2, h2);
 
-  if( loop->recording || loop->stacking ){
+  if( recording || stacking ){
     g.setColour (Colour (0xffb33f3f));
     g.fillEllipse (10, 10, 4, 4);
       x+=10;
   }
-  if( !loop->playing && !loop->recording && loop->numSamples ){
+  if( !playing && !recording && m.numSamples ){
     g.setColour( Colour(10, 70, 70) );
     g.fillRect( x,10, 1, 4);
     g.fillRect( x+2, 10, 1, 4);
@@ -135,6 +144,12 @@ void LoopComponent::paint (Graphics& g)
     //g.fillRect (10, 39, 30, 2);
 
     //[UserPaint] Add your own custom painting code here..
+  //import progress
+  LooperImportStatus status;
+  if( import && import->getStatus( index, status ) && status.busy ){
+    g.setColour( Colour( 58,172,62 ).withAlpha(.8f) );
+    g.fillRect( 10, 43, (int)(30 * status.progress), 1 );
+  }
     //[/UserPaint]
 }
 
@@ -147,6 +162,10 @@ void LoopComponent::resized()
 void LoopComponent::filesDropped (const StringArray& filenames, int mouseX, int mouseY)
 {
     //[UserCode_filesDropped] -- Add your code here...
+  if( !import ) return;
+  Array<File> files;
+  for( int i=0; i < filenames.size(); i++) files.add( File(filenames[i]) );
+  import->importAll( index, files );
     //[/UserCode_filesDropped]
 }
 
@@ -172,18 +191,18 @@ void LoopComponent::mouseWheelMove (const MouseEvent& e, float wheelIncrementX,
       //loop.b[0].rPos += wheelIncrementX*1024;
       //while( loop.b[0].rPos < loop.b[0].rMin ) loop.b[0].rPos += (loop.b[0].rMax-loop.b[0].rMin);
       //while( loop.b[0].rPos > loop.b[0].rMax ) loop.b[0].rPos -= (loop.b[0].rMax-loop.b[0].rMin);
-        loop->decay -= wheelIncrementY;
-        if( loop->decay > 1.f ) loop->decay = 1.f;
-        else if( loop->decay < 0.f ) loop->decay = 0.f;
+        float decay = looper->meter(index).decay - wheelIncrementY;
+        if( decay > 1.f ) decay = 1.f;
+        else if( decay < 0.f ) decay = 0.f;
+        looper->setDecay( index, decay );
       
     }else{
-      loop->gain += wheelIncrementY;
-      if( loop->gain < 0.f ) loop->gain = 0.f;
-      else if( loop->gain > 3.0f) loop->gain = 3.0f;
+      float gain = looper->meter(index).gain + wheelIncrementY;
+      if( gain < 0.f ) gain = 0.f;
+      else if( gain > 3.0f) gain = 3.0f;
+      looper->setGain( index, gain );
         
-        loop->pan -= wheelIncrementX;
-        if( loop->pan > 1.f ) loop->pan = 1.f;
-        else if( loop->pan < 0.f ) loop->pan = 0.f;
+        looper->setPan( index, looper->meter(index).pan - wheelIncrementX );
       
     }
     //[/UserCode_mouseWheelMove]
@@ -199,13 +218,19 @@ void LoopComponent::focusGained (FocusChangeType cause)
 
 //[MiscUserCode] You can add your own definitions of your custom methods or any other code here...
 
+bool LoopComponent::isInterestedInFileDrag (const StringArray& files){
+  if( !import ) return false;
+  for( int i=0; i < files.size(); i++)
+    if( import->canImport( File(files[i]) ) ) return true;
+  return false;
+}
 
 void LoopComponent::audioDeviceIOCallback (const float** inputChannelData,
                             int totalNumInputChannels,
                             float** outputChannelData,
                             int totalNumOutputChannels,
                                            int numSamples){
-    loop->audioIO( (float**)inputChannelData, (float**)outputChannelData, numSamples );
+    loop->audioIO( (float**)inputChannelData, totalNumInputChannels, (float**)outputChannelData, totalNumOutputChannels, numSamples );
 }
 void LoopComponent::audioDeviceAboutToStart (AudioIODevice* device){}
 void LoopComponent::audioDeviceStopped(){}
@@ -221,7 +246,7 @@ void LoopComponent::audioDeviceStopped(){}
 BEGIN_JUCER_METADATA
 
 <JUCER_COMPONENT documentType="Component" className="LoopComponent" componentName=""
-                 parentClasses="public Component" constructorParams="" variableInitialisers=""
+                 parentClasses="public Component, public SettableTooltipClient, public FileDragAndDropTarget" constructorParams="" variableInitialisers=""
                  snapPixels="8" snapActive="1" snapShown="1" overlayOpacity="0.330000013"
                  fixedSize="1" initialWidth="50" initialHeight="50">
   <METHODS>
@@ -24,7 +24,9 @@
 
 //[Headers]     -- You can add your own extra header files here --
 #include "../JuceLibraryCode/JuceHeader.h"
-#include "LoopBuffer.h"
+#include "Looper.h"
+
+class LooperImport;
 //[/Headers]
 
 
@@ -37,7 +39,9 @@
     Describe your class and how it works here!
                                                                     //[/Comments]
 */
-class LoopComponent  : public Component
+class LoopComponent  : public Component,
+                       public SettableTooltipClient,
+                       public FileDragAndDropTarget
 {
 public:
     //==============================================================================
@@ -46,7 +50,7 @@ public:
 
     //==============================================================================
     //[UserMethods]     -- You can add your own custom methods in this section.
-    LoopComponent( Loop *loop_, char* c);
+    LoopComponent( Looper *looper_, int index_, char* c);
     void audioDeviceIOCallback (const float** inputChannelData,
                                 int totalNumInputChannels,
                                 float** outputChannelData,
@@ -55,9 +59,14 @@ public:
     void audioDeviceAboutToStart (AudioIODevice* device);
     void audioDeviceStopped();
 
+    Looper *looper;
+    int index;
     Loop *loop;
     char* ident;
     bool selected;
+    LooperImport *import; //files dropped go here, none if 0
+
+    bool isInterestedInFileDrag (const StringArray& files);
     //[/UserMethods]
 
     void paint (Graphics& g);
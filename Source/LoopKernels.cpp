@@ -0,0 +1,756 @@
+
+#include <math.h>
+#include <string.h>
+#include <iostream>
+
+#include "LoopKernels.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+ #if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+  #define LOOP_KERNELS_AVX2 1
+  #include <immintrin.h>
+  #include <cpuid.h>
+  #define AVX2_TARGET __attribute__((target("avx2")))
+ #endif
+#endif
+
+#define SINC_PHASES (1 << LOOP_SINC_PHASE_BITS)
+
+//polyphase table, row p holds the taps for a position p/SINC_PHASES past a sample.
+//tap t weights the sample t - (LOOP_SINC_TAPS/2 - 1) away. built before main
+static struct SincTable {
+  float h[SINC_PHASES][LOOP_SINC_TAPS];
+
+  SincTable(){
+    const double cutoff = 0.9; //of nyquist, some roll off in exchange for less aliasing
+    const double half = LOOP_SINC_TAPS / 2;
+    for( int p=0; p < SINC_PHASES; p++){
+      double sum = 0.0, row[LOOP_SINC_TAPS];
+      for( int t=0; t < LOOP_SINC_TAPS; t++){
+        double x = t - (half - 1) - (double)p / SINC_PHASES;
+        double s = x == 0.0 ? cutoff : sin( double_Pi * cutoff * x ) / (double_Pi * x);
+        double w = 0.42 + 0.5 * cos( double_Pi * x / half ) + 0.08 * cos( 2.0 * double_Pi * x / half );
+        row[t] = s * w;
+        sum += row[t];
+      }
+      //unity gain at dc for every phase
+      for( int t=0; t < LOOP_SINC_TAPS; t++) h[p][t] = (float)(row[t] / sum);
+    }
+  }
+} sincTable;
+
+//sample index and interpolation fraction of a 32.32 phase
+static inline int phaseIndex( uint64 phase ){ return (int)(phase >> 32); }
+static inline float phaseFrac( uint64 phase ){ return (float)(uint32)phase * (1.f / 4294967296.f); }
+static inline const float* sincRow( uint64 phase ){ return sincTable.h[ (uint32)phase >> (32 - LOOP_SINC_PHASE_BITS) ]; }
+
+/*
+ * scalar, the reference everything else is checked against
+ */
+static void copyGainScalar( float *dst, const float *src, float gain, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] = src[i] * gain;
+}
+static void copyGainRScalar( float *dst, const float *src, float gain, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] = src[-(int)i] * gain;
+}
+static void addScalar( float *dst, const float *src, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] += src[i];
+}
+static void addRScalar( float *dst, const float *src, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[-(int)i] += src[i];
+}
+static void scaleScalar( float *dst, float gain, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] *= gain;
+}
+static double sumSquaresScalar( const float *src, unsigned int n ){
+  double sum = 0.0;
+  for( unsigned int i=0; i < n; i++) sum += src[i]*src[i];
+  return sum;
+}
+static double dotScalar( const float *a, const float *b, unsigned int n ){
+  double sum = 0.0;
+  for( unsigned int i=0; i < n; i++) sum += a[i]*b[i];
+  return sum;
+}
+static double meterScalar( const float *src, unsigned int n, float *peak ){
+  double sum = 0.0;
+  float p = *peak;
+  for( unsigned int i=0; i < n; i++){
+    sum += src[i]*src[i];
+    float a = fabsf(src[i]);
+    if( a > p ) p = a;
+  }
+  *peak = p;
+  return sum;
+}
+static void overdubScalar( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  for( unsigned int i=0; i < n; i++){
+    float s = buf[i];
+    out[i] = s * gain;
+    buf[i] = s * decay + in[i];
+  }
+}
+static void overdubRScalar( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  for( unsigned int i=0; i < n; i++){
+    float s = buf[-(int)i];
+    out[i] = s * gain;
+    buf[-(int)i] = s * decay + in[i];
+  }
+}
+static void mulAddScalar( float *dst, const float *a, const float *b, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] += a[i] * b[i];
+}
+static void mixScalar( float *dst, const float *src, float gain, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] += src[i] * gain;
+}
+static void panMixScalar( float *outL, float *outR, const float *src, float l, float r, unsigned int n ){
+  for( unsigned int i=0; i < n; i++){
+    outL[i] += src[i] * l;
+    outR[i] += src[i] * r;
+  }
+}
+static void fromIntScalar( float *dst, const int *src, float scale, unsigned int n ){
+  for( unsigned int i=0; i < n; i++) dst[i] = (float)src[i] * scale;
+}
+static void toIntScalar( int *dst, const float *src, const float *dither, float scale, unsigned int shift, unsigned int n ){
+  for( unsigned int i=0; i < n; i++){
+    float x = src[i] * scale;
+    if( dither ) x += dither[i];
+    x = jlimit( -scale, scale - 1.f, x );
+    //shifted unsigned, a negative int must not be
+    dst[i] = (int)( (uint32)lrintf( x ) << shift );
+  }
+}
+static inline uint32 xorshift( uint32& x ){
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+static void tpdfScalar( float *dst, uint32 *state, unsigned int n ){
+  for( unsigned int i=0; i < n; i++){
+    uint32& x = state[ i % LOOP_DITHER_LANES ];
+    float u = (float)(xorshift(x) >> 16);
+    dst[i] = (u - (float)(xorshift(x) >> 16)) * (1.f / 65536.f);
+  }
+}
+static void interpLinearScalar( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  for( unsigned int i=0; i < n; i++, phase += step){
+    const float *s = src + phaseIndex(phase);
+    out[i] = s[0] + (s[1] - s[0]) * phaseFrac(phase);
+  }
+}
+static inline float hermite( float xm1, float x0, float x1, float x2, float f ){
+  float c1 = 0.5f * (x1 - xm1);
+  float c2 = xm1 - 2.5f * x0 + 2.f * x1 - 0.5f * x2;
+  float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+  return ((c3 * f + c2) * f + c1) * f + x0;
+}
+static void interpHermiteScalar( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  for( unsigned int i=0; i < n; i++, phase += step){
+    const float *s = src + phaseIndex(phase);
+    out[i] = hermite( s[-1], s[0], s[1], s[2], phaseFrac(phase) );
+  }
+}
+static void interpSincScalar( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  for( unsigned int i=0; i < n; i++, phase += step){
+    const float *s = src + phaseIndex(phase) - (LOOP_SINC_TAPS/2 - 1);
+    const float *h = sincRow(phase);
+    float sum = 0.f;
+    for( int t=0; t < LOOP_SINC_TAPS; t++) sum += s[t] * h[t];
+    out[i] = sum;
+  }
+}
+
+static const LoopKernels scalarKernels = {
+  copyGainScalar, copyGainRScalar, addScalar, addRScalar, scaleScalar, sumSquaresScalar, dotScalar, meterScalar,
+  overdubScalar, overdubRScalar, mulAddScalar, mixScalar, panMixScalar, fromIntScalar, toIntScalar, tpdfScalar,
+  interpLinearScalar, interpHermiteScalar, interpSincScalar, "scalar"
+};
+
+#if JUCE_INTEL
+/*
+ * SSE2, 4 floats at a time, scalar tails
+ */
+#define REVERSE4(v) _mm_shuffle_ps( v, v, _MM_SHUFFLE(0,1,2,3) )
+
+static void copyGainSSE2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain);
+  for( ; i+4 <= n; i+=4) _mm_storeu_ps( dst+i, _mm_mul_ps( _mm_loadu_ps(src+i), g ) );
+  copyGainScalar( dst+i, src+i, gain, n-i );
+}
+static void copyGainRSSE2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain);
+  for( ; i+4 <= n; i+=4){
+    __m128 v = _mm_loadu_ps( src - (int)i - 3 );
+    _mm_storeu_ps( dst+i, _mm_mul_ps( REVERSE4(v), g ) );
+  }
+  copyGainRScalar( dst+i, src-(int)i, gain, n-i );
+}
+static void addSSE2( float *dst, const float *src, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+4 <= n; i+=4) _mm_storeu_ps( dst+i, _mm_add_ps( _mm_loadu_ps(dst+i), _mm_loadu_ps(src+i) ) );
+  addScalar( dst+i, src+i, n-i );
+}
+static void addRSSE2( float *dst, const float *src, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+4 <= n; i+=4){
+    float *d = dst - (int)i - 3;
+    __m128 v = _mm_loadu_ps( src+i );
+    _mm_storeu_ps( d, _mm_add_ps( _mm_loadu_ps(d), REVERSE4(v) ) );
+  }
+  addRScalar( dst-(int)i, src+i, n-i );
+}
+static void scaleSSE2( float *dst, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain);
+  for( ; i+4 <= n; i+=4) _mm_storeu_ps( dst+i, _mm_mul_ps( _mm_loadu_ps(dst+i), g ) );
+  scaleScalar( dst+i, gain, n-i );
+}
+//squares are rounded to float like the scalar loop, only the summation order differs
+static double sumSquaresSSE2( const float *src, unsigned int n ){
+  unsigned int i=0;
+  __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+  for( ; i+4 <= n; i+=4){
+    __m128 v = _mm_loadu_ps(src+i);
+    v = _mm_mul_ps(v,v);
+    lo = _mm_add_pd( lo, _mm_cvtps_pd(v) );
+    hi = _mm_add_pd( hi, _mm_cvtps_pd( _mm_movehl_ps(v,v) ) );
+  }
+  double sum[2];
+  _mm_storeu_pd( sum, _mm_add_pd(lo,hi) );
+  return sum[0] + sum[1] + sumSquaresScalar( src+i, n-i );
+}
+static double dotSSE2( const float *a, const float *b, unsigned int n ){
+  unsigned int i=0;
+  __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+  for( ; i+4 <= n; i+=4){
+    __m128 v = _mm_mul_ps( _mm_loadu_ps(a+i), _mm_loadu_ps(b+i) );
+    lo = _mm_add_pd( lo, _mm_cvtps_pd(v) );
+    hi = _mm_add_pd( hi, _mm_cvtps_pd( _mm_movehl_ps(v,v) ) );
+  }
+  double sum[2];
+  _mm_storeu_pd( sum, _mm_add_pd(lo,hi) );
+  return sum[0] + sum[1] + dotScalar( a+i, b+i, n-i );
+}
+static double meterSSE2( const float *src, unsigned int n, float *peak ){
+  unsigned int i=0;
+  __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+  __m128 p = _mm_set1_ps(*peak), abs = _mm_castsi128_ps( _mm_set1_epi32(0x7fffffff) );
+  for( ; i+4 <= n; i+=4){
+    __m128 v = _mm_loadu_ps(src+i);
+    p = _mm_max_ps( p, _mm_and_ps(v,abs) );
+    v = _mm_mul_ps(v,v);
+    lo = _mm_add_pd( lo, _mm_cvtps_pd(v) );
+    hi = _mm_add_pd( hi, _mm_cvtps_pd( _mm_movehl_ps(v,v) ) );
+  }
+  p = _mm_max_ps( p, _mm_movehl_ps(p,p) );
+  p = _mm_max_ss( p, _mm_shuffle_ps(p,p,1) );
+  _mm_store_ss( peak, p );
+  double sum[2];
+  _mm_storeu_pd( sum, _mm_add_pd(lo,hi) );
+  return sum[0] + sum[1] + meterScalar( src+i, n-i, peak );
+}
+static void overdubSSE2( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain), d = _mm_set1_ps(decay);
+  for( ; i+4 <= n; i+=4){
+    __m128 s = _mm_loadu_ps(buf+i);
+    _mm_storeu_ps( out+i, _mm_mul_ps(s,g) );
+    _mm_storeu_ps( buf+i, _mm_add_ps( _mm_mul_ps(s,d), _mm_loadu_ps(in+i) ) );
+  }
+  overdubScalar( out+i, buf+i, in+i, gain, decay, n-i );
+}
+static void overdubRSSE2( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain), d = _mm_set1_ps(decay);
+  for( ; i+4 <= n; i+=4){
+    float *b = buf - (int)i - 3;
+    __m128 s = _mm_loadu_ps(b);
+    __m128 v = _mm_loadu_ps(in+i);
+    _mm_storeu_ps( out+i, _mm_mul_ps( REVERSE4(s), g ) );
+    _mm_storeu_ps( b, _mm_add_ps( _mm_mul_ps(s,d), REVERSE4(v) ) );
+  }
+  overdubRScalar( out+i, buf-(int)i, in+i, gain, decay, n-i );
+}
+static void mulAddSSE2( float *dst, const float *a, const float *b, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+4 <= n; i+=4)
+    _mm_storeu_ps( dst+i, _mm_add_ps( _mm_loadu_ps(dst+i), _mm_mul_ps( _mm_loadu_ps(a+i), _mm_loadu_ps(b+i) ) ) );
+  mulAddScalar( dst+i, a+i, b+i, n-i );
+}
+static void mixSSE2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(gain);
+  for( ; i+4 <= n; i+=4)
+    _mm_storeu_ps( dst+i, _mm_add_ps( _mm_loadu_ps(dst+i), _mm_mul_ps( _mm_loadu_ps(src+i), g ) ) );
+  mixScalar( dst+i, src+i, gain, n-i );
+}
+static void panMixSSE2( float *outL, float *outR, const float *src, float l, float r, unsigned int n ){
+  unsigned int i=0;
+  __m128 gl = _mm_set1_ps(l), gr = _mm_set1_ps(r);
+  for( ; i+4 <= n; i+=4){
+    __m128 v = _mm_loadu_ps(src+i);
+    _mm_storeu_ps( outL+i, _mm_add_ps( _mm_loadu_ps(outL+i), _mm_mul_ps(v,gl) ) );
+    _mm_storeu_ps( outR+i, _mm_add_ps( _mm_loadu_ps(outR+i), _mm_mul_ps(v,gr) ) );
+  }
+  panMixScalar( outL+i, outR+i, src+i, l, r, n-i );
+}
+static void fromIntSSE2( float *dst, const int *src, float scale, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(scale);
+  for( ; i+4 <= n; i+=4)
+    _mm_storeu_ps( dst+i, _mm_mul_ps( _mm_cvtepi32_ps( _mm_loadu_si128( (const __m128i*)(src+i) ) ), g ) );
+  fromIntScalar( dst+i, src+i, scale, n-i );
+}
+static void toIntSSE2( int *dst, const float *src, const float *dither, float scale, unsigned int shift, unsigned int n ){
+  unsigned int i=0;
+  __m128 g = _mm_set1_ps(scale), lo = _mm_set1_ps(-scale), hi = _mm_set1_ps(scale - 1.f);
+  __m128i s = _mm_cvtsi32_si128( shift );
+  for( ; i+4 <= n; i+=4){
+    __m128 x = _mm_mul_ps( _mm_loadu_ps(src+i), g );
+    if( dither ) x = _mm_add_ps( x, _mm_loadu_ps(dither+i) );
+    x = _mm_min_ps( _mm_max_ps( x, lo ), hi );
+    _mm_storeu_si128( (__m128i*)(dst+i), _mm_sll_epi32( _mm_cvtps_epi32(x), s ) );
+  }
+  toIntScalar( dst+i, src+i, dither ? dither+i : 0, scale, shift, n-i );
+}
+static inline __m128i xorshift4( __m128i x ){
+  x = _mm_xor_si128( x, _mm_slli_epi32( x, 13 ) );
+  x = _mm_xor_si128( x, _mm_srli_epi32( x, 17 ) );
+  return _mm_xor_si128( x, _mm_slli_epi32( x, 5 ) );
+}
+//the state as two halves of 4 lanes, 8 samples a step
+static void tpdfSSE2( float *dst, uint32 *state, unsigned int n ){
+  unsigned int i=0;
+  __m128i a = _mm_loadu_si128( (const __m128i*)state ), b = _mm_loadu_si128( (const __m128i*)(state+4) );
+  const __m128 unit = _mm_set1_ps( 1.f / 65536.f );
+  for( ; i+8 <= n; i+=8){
+    a = xorshift4(a);
+    __m128 u = _mm_cvtepi32_ps( _mm_srli_epi32( a, 16 ) );
+    a = xorshift4(a);
+    _mm_storeu_ps( dst+i, _mm_mul_ps( _mm_sub_ps( u, _mm_cvtepi32_ps( _mm_srli_epi32( a, 16 ) ) ), unit ) );
+    b = xorshift4(b);
+    u = _mm_cvtepi32_ps( _mm_srli_epi32( b, 16 ) );
+    b = xorshift4(b);
+    _mm_storeu_ps( dst+i+4, _mm_mul_ps( _mm_sub_ps( u, _mm_cvtepi32_ps( _mm_srli_epi32( b, 16 ) ) ), unit ) );
+  }
+  _mm_storeu_si128( (__m128i*)state, a );
+  _mm_storeu_si128( (__m128i*)(state+4), b );
+  tpdfScalar( dst+i, state, n-i );
+}
+
+//positions are stepped in integer, 4 at a time, the arithmetic is vectored
+#define PHASES4( idx, frac ) \
+  int idx[4]; float frac[4]; \
+  for( int j=0; j < 4; j++, phase += step){ idx[j] = phaseIndex(phase); frac[j] = phaseFrac(phase); }
+#define GATHER4( src, idx, o ) _mm_setr_ps( src[idx[0]+o], src[idx[1]+o], src[idx[2]+o], src[idx[3]+o] )
+
+static void interpLinearSSE2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+4 <= n; i+=4){
+    PHASES4( idx, frac );
+    __m128 s0 = GATHER4( src, idx, 0 ), s1 = GATHER4( src, idx, 1 );
+    _mm_storeu_ps( out+i, _mm_add_ps( s0, _mm_mul_ps( _mm_sub_ps(s1,s0), _mm_loadu_ps(frac) ) ) );
+  }
+  interpLinearScalar( out+i, src, phase, step, n-i );
+}
+static void interpHermiteSSE2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  unsigned int i=0;
+  const __m128 half = _mm_set1_ps(0.5f), two = _mm_set1_ps(2.f), twohalf = _mm_set1_ps(2.5f), onehalf = _mm_set1_ps(1.5f);
+  for( ; i+4 <= n; i+=4){
+    PHASES4( idx, frac );
+    __m128 xm1 = GATHER4( src, idx, -1 ), x0 = GATHER4( src, idx, 0 ), x1 = GATHER4( src, idx, 1 ), x2 = GATHER4( src, idx, 2 );
+    __m128 f = _mm_loadu_ps(frac);
+    __m128 c1 = _mm_mul_ps( half, _mm_sub_ps(x1,xm1) );
+    __m128 c2 = _mm_sub_ps( _mm_add_ps( _mm_sub_ps( xm1, _mm_mul_ps(twohalf,x0) ), _mm_mul_ps(two,x1) ), _mm_mul_ps(half,x2) );
+    __m128 c3 = _mm_add_ps( _mm_mul_ps( half, _mm_sub_ps(x2,xm1) ), _mm_mul_ps( onehalf, _mm_sub_ps(x0,x1) ) );
+    __m128 y = _mm_add_ps( _mm_mul_ps(c3,f), c2 );
+    y = _mm_add_ps( _mm_mul_ps(y,f), c1 );
+    _mm_storeu_ps( out+i, _mm_add_ps( _mm_mul_ps(y,f), x0 ) );
+  }
+  interpHermiteScalar( out+i, src, phase, step, n-i );
+}
+//one output per iteration, the taps are the vector
+static void interpSincSSE2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  for( unsigned int i=0; i < n; i++, phase += step){
+    const float *s = src + phaseIndex(phase) - (LOOP_SINC_TAPS/2 - 1);
+    const float *h = sincRow(phase);
+    __m128 acc = _mm_mul_ps( _mm_loadu_ps(s), _mm_loadu_ps(h) );
+    for( int t=4; t < LOOP_SINC_TAPS; t+=4)
+      acc = _mm_add_ps( acc, _mm_mul_ps( _mm_loadu_ps(s+t), _mm_loadu_ps(h+t) ) );
+    acc = _mm_add_ps( acc, _mm_movehl_ps(acc,acc) );
+    acc = _mm_add_ss( acc, _mm_shuffle_ps(acc,acc,1) );
+    _mm_store_ss( out+i, acc );
+  }
+}
+
+static const LoopKernels sse2Kernels = {
+  copyGainSSE2, copyGainRSSE2, addSSE2, addRSSE2, scaleSSE2, sumSquaresSSE2, dotSSE2, meterSSE2,
+  overdubSSE2, overdubRSSE2, mulAddSSE2, mixSSE2, panMixSSE2, fromIntSSE2, toIntSSE2, tpdfSSE2,
+  interpLinearSSE2, interpHermiteSSE2, interpSincSSE2, "sse2"
+};
+#endif
+
+#if LOOP_KERNELS_AVX2
+/*
+ * AVX2, 8 floats at a time, SSE2 tails. no fma so products round the same as scalar
+ */
+AVX2_TARGET static inline __m256 reverse8( __m256 v ){
+  return _mm256_permutevar8x32_ps( v, _mm256_set_epi32(0,1,2,3,4,5,6,7) );
+}
+
+AVX2_TARGET static void copyGainAVX2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain);
+  for( ; i+8 <= n; i+=8) _mm256_storeu_ps( dst+i, _mm256_mul_ps( _mm256_loadu_ps(src+i), g ) );
+  copyGainSSE2( dst+i, src+i, gain, n-i );
+}
+AVX2_TARGET static void copyGainRAVX2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain);
+  for( ; i+8 <= n; i+=8)
+    _mm256_storeu_ps( dst+i, _mm256_mul_ps( reverse8( _mm256_loadu_ps( src - (int)i - 7 ) ), g ) );
+  copyGainRSSE2( dst+i, src-(int)i, gain, n-i );
+}
+AVX2_TARGET static void addAVX2( float *dst, const float *src, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+8 <= n; i+=8) _mm256_storeu_ps( dst+i, _mm256_add_ps( _mm256_loadu_ps(dst+i), _mm256_loadu_ps(src+i) ) );
+  addSSE2( dst+i, src+i, n-i );
+}
+AVX2_TARGET static void addRAVX2( float *dst, const float *src, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+8 <= n; i+=8){
+    float *d = dst - (int)i - 7;
+    _mm256_storeu_ps( d, _mm256_add_ps( _mm256_loadu_ps(d), reverse8( _mm256_loadu_ps(src+i) ) ) );
+  }
+  addRSSE2( dst-(int)i, src+i, n-i );
+}
+AVX2_TARGET static void scaleAVX2( float *dst, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain);
+  for( ; i+8 <= n; i+=8) _mm256_storeu_ps( dst+i, _mm256_mul_ps( _mm256_loadu_ps(dst+i), g ) );
+  scaleSSE2( dst+i, gain, n-i );
+}
+AVX2_TARGET static double sumSquaresAVX2( const float *src, unsigned int n ){
+  unsigned int i=0;
+  __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+  for( ; i+8 <= n; i+=8){
+    __m256 v = _mm256_loadu_ps(src+i);
+    v = _mm256_mul_ps(v,v);
+    lo = _mm256_add_pd( lo, _mm256_cvtps_pd( _mm256_castps256_ps128(v) ) );
+    hi = _mm256_add_pd( hi, _mm256_cvtps_pd( _mm256_extractf128_ps(v,1) ) );
+  }
+  double sum[4];
+  _mm256_storeu_pd( sum, _mm256_add_pd(lo,hi) );
+  return sum[0] + sum[1] + sum[2] + sum[3] + sumSquaresSSE2( src+i, n-i );
+}
+AVX2_TARGET static double dotAVX2( const float *a, const float *b, unsigned int n ){
+  unsigned int i=0;
+  __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+  for( ; i+8 <= n; i+=8){
+    __m256 v = _mm256_mul_ps( _mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i) );
+    lo = _mm256_add_pd( lo, _mm256_cvtps_pd( _mm256_castps256_ps128(v) ) );
+    hi = _mm256_add_pd( hi, _mm256_cvtps_pd( _mm256_extractf128_ps(v,1) ) );
+  }
+  double sum[4];
+  _mm256_storeu_pd( sum, _mm256_add_pd(lo,hi) );
+  return sum[0] + sum[1] + sum[2] + sum[3] + dotSSE2( a+i, b+i, n-i );
+}
+AVX2_TARGET static double meterAVX2( const float *src, unsigned int n, float *peak ){
+  unsigned int i=0;
+  __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+  __m256 p = _mm256_set1_ps(*peak), abs = _mm256_castsi256_ps( _mm256_set1_epi32(0x7fffffff) );
+  for( ; i+8 <= n; i+=8){
+    __m256 v = _mm256_loadu_ps(src+i);
+    p = _mm256_max_ps( p, _mm256_and_ps(v,abs) );
+    v = _mm256_mul_ps(v,v);
+    lo = _mm256_add_pd( lo, _mm256_cvtps_pd( _mm256_castps256_ps128(v) ) );
+    hi = _mm256_add_pd( hi, _mm256_cvtps_pd( _mm256_extractf128_ps(v,1) ) );
+  }
+  __m128 p4 = _mm_max_ps( _mm256_castps256_ps128(p), _mm256_extractf128_ps(p,1) );
+  p4 = _mm_max_ps( p4, _mm_movehl_ps(p4,p4) );
+  p4 = _mm_max_ss( p4, _mm_shuffle_ps(p4,p4,1) );
+  _mm_store_ss( peak, p4 );
+  double sum[4];
+  _mm256_storeu_pd( sum, _mm256_add_pd(lo,hi) );
+  return sum[0] + sum[1] + sum[2] + sum[3] + meterSSE2( src+i, n-i, peak );
+}
+AVX2_TARGET static void overdubAVX2( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain), d = _mm256_set1_ps(decay);
+  for( ; i+8 <= n; i+=8){
+    __m256 s = _mm256_loadu_ps(buf+i);
+    _mm256_storeu_ps( out+i, _mm256_mul_ps(s,g) );
+    _mm256_storeu_ps( buf+i, _mm256_add_ps( _mm256_mul_ps(s,d), _mm256_loadu_ps(in+i) ) );
+  }
+  overdubSSE2( out+i, buf+i, in+i, gain, decay, n-i );
+}
+AVX2_TARGET static void overdubRAVX2( float *out, float *buf, const float *in, float gain, float decay, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain), d = _mm256_set1_ps(decay);
+  for( ; i+8 <= n; i+=8){
+    float *b = buf - (int)i - 7;
+    __m256 s = _mm256_loadu_ps(b);
+    _mm256_storeu_ps( out+i, _mm256_mul_ps( reverse8(s), g ) );
+    _mm256_storeu_ps( b, _mm256_add_ps( _mm256_mul_ps(s,d), reverse8( _mm256_loadu_ps(in+i) ) ) );
+  }
+  overdubRSSE2( out+i, buf-(int)i, in+i, gain, decay, n-i );
+}
+AVX2_TARGET static void mulAddAVX2( float *dst, const float *a, const float *b, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+8 <= n; i+=8)
+    _mm256_storeu_ps( dst+i, _mm256_add_ps( _mm256_loadu_ps(dst+i), _mm256_mul_ps( _mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i) ) ) );
+  mulAddSSE2( dst+i, a+i, b+i, n-i );
+}
+AVX2_TARGET static void mixAVX2( float *dst, const float *src, float gain, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(gain);
+  for( ; i+8 <= n; i+=8)
+    _mm256_storeu_ps( dst+i, _mm256_add_ps( _mm256_loadu_ps(dst+i), _mm256_mul_ps( _mm256_loadu_ps(src+i), g ) ) );
+  mixSSE2( dst+i, src+i, gain, n-i );
+}
+AVX2_TARGET static void panMixAVX2( float *outL, float *outR, const float *src, float l, float r, unsigned int n ){
+  unsigned int i=0;
+  __m256 gl = _mm256_set1_ps(l), gr = _mm256_set1_ps(r);
+  for( ; i+8 <= n; i+=8){
+    __m256 v = _mm256_loadu_ps(src+i);
+    _mm256_storeu_ps( outL+i, _mm256_add_ps( _mm256_loadu_ps(outL+i), _mm256_mul_ps(v,gl) ) );
+    _mm256_storeu_ps( outR+i, _mm256_add_ps( _mm256_loadu_ps(outR+i), _mm256_mul_ps(v,gr) ) );
+  }
+  panMixSSE2( outL+i, outR+i, src+i, l, r, n-i );
+}
+AVX2_TARGET static void fromIntAVX2( float *dst, const int *src, float scale, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(scale);
+  for( ; i+8 <= n; i+=8)
+    _mm256_storeu_ps( dst+i, _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_loadu_si256( (const __m256i*)(src+i) ) ), g ) );
+  fromIntSSE2( dst+i, src+i, scale, n-i );
+}
+
+AVX2_TARGET static void toIntAVX2( int *dst, const float *src, const float *dither, float scale, unsigned int shift, unsigned int n ){
+  unsigned int i=0;
+  __m256 g = _mm256_set1_ps(scale), lo = _mm256_set1_ps(-scale), hi = _mm256_set1_ps(scale - 1.f);
+  __m128i s = _mm_cvtsi32_si128( shift );
+  for( ; i+8 <= n; i+=8){
+    __m256 x = _mm256_mul_ps( _mm256_loadu_ps(src+i), g );
+    if( dither ) x = _mm256_add_ps( x, _mm256_loadu_ps(dither+i) );
+    x = _mm256_min_ps( _mm256_max_ps( x, lo ), hi );
+    _mm256_storeu_si256( (__m256i*)(dst+i), _mm256_sll_epi32( _mm256_cvtps_epi32(x), s ) );
+  }
+  toIntSSE2( dst+i, src+i, dither ? dither+i : 0, scale, shift, n-i );
+}
+AVX2_TARGET static inline __m256i xorshift8( __m256i x ){
+  x = _mm256_xor_si256( x, _mm256_slli_epi32( x, 13 ) );
+  x = _mm256_xor_si256( x, _mm256_srli_epi32( x, 17 ) );
+  return _mm256_xor_si256( x, _mm256_slli_epi32( x, 5 ) );
+}
+AVX2_TARGET static void tpdfAVX2( float *dst, uint32 *state, unsigned int n ){
+  unsigned int i=0;
+  __m256i x = _mm256_loadu_si256( (const __m256i*)state );
+  const __m256 unit = _mm256_set1_ps( 1.f / 65536.f );
+  for( ; i+8 <= n; i+=8){
+    x = xorshift8(x);
+    __m256 u = _mm256_cvtepi32_ps( _mm256_srli_epi32( x, 16 ) );
+    x = xorshift8(x);
+    _mm256_storeu_ps( dst+i, _mm256_mul_ps( _mm256_sub_ps( u, _mm256_cvtepi32_ps( _mm256_srli_epi32( x, 16 ) ) ), unit ) );
+  }
+  _mm256_storeu_si256( (__m256i*)state, x );
+  tpdfScalar( dst+i, state, n-i );
+}
+
+#define PHASES8( idx, frac ) \
+  int idx[8]; float frac[8]; \
+  for( int j=0; j < 8; j++, phase += step){ idx[j] = phaseIndex(phase); frac[j] = phaseFrac(phase); }
+
+AVX2_TARGET static void interpLinearAVX2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  unsigned int i=0;
+  for( ; i+8 <= n; i+=8){
+    PHASES8( idx, frac );
+    __m256i vi = _mm256_loadu_si256( (const __m256i*)idx );
+    __m256 s0 = _mm256_i32gather_ps( src, vi, 4 ), s1 = _mm256_i32gather_ps( src+1, vi, 4 );
+    _mm256_storeu_ps( out+i, _mm256_add_ps( s0, _mm256_mul_ps( _mm256_sub_ps(s1,s0), _mm256_loadu_ps(frac) ) ) );
+  }
+  interpLinearSSE2( out+i, src, phase, step, n-i );
+}
+AVX2_TARGET static void interpHermiteAVX2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  unsigned int i=0;
+  const __m256 half = _mm256_set1_ps(0.5f), two = _mm256_set1_ps(2.f), twohalf = _mm256_set1_ps(2.5f), onehalf = _mm256_set1_ps(1.5f);
+  for( ; i+8 <= n; i+=8){
+    PHASES8( idx, frac );
+    __m256i vi = _mm256_loadu_si256( (const __m256i*)idx );
+    __m256 xm1 = _mm256_i32gather_ps( src-1, vi, 4 ), x0 = _mm256_i32gather_ps( src, vi, 4 );
+    __m256 x1 = _mm256_i32gather_ps( src+1, vi, 4 ), x2 = _mm256_i32gather_ps( src+2, vi, 4 );
+    __m256 f = _mm256_loadu_ps(frac);
+    __m256 c1 = _mm256_mul_ps( half, _mm256_sub_ps(x1,xm1) );
+    __m256 c2 = _mm256_sub_ps( _mm256_add_ps( _mm256_sub_ps( xm1, _mm256_mul_ps(twohalf,x0) ), _mm256_mul_ps(two,x1) ), _mm256_mul_ps(half,x2) );
+    __m256 c3 = _mm256_add_ps( _mm256_mul_ps( half, _mm256_sub_ps(x2,xm1) ), _mm256_mul_ps( onehalf, _mm256_sub_ps(x0,x1) ) );
+    __m256 y = _mm256_add_ps( _mm256_mul_ps(c3,f), c2 );
+    y = _mm256_add_ps( _mm256_mul_ps(y,f), c1 );
+    _mm256_storeu_ps( out+i, _mm256_add_ps( _mm256_mul_ps(y,f), x0 ) );
+  }
+  interpHermiteSSE2( out+i, src, phase, step, n-i );
+}
+AVX2_TARGET static void interpSincAVX2( float *out, const float *src, uint64 phase, uint64 step, unsigned int n ){
+  for( unsigned int i=0; i < n; i++, phase += step){
+    const float *s = src + phaseIndex(phase) - (LOOP_SINC_TAPS/2 - 1);
+    const float *h = sincRow(phase);
+    __m256 acc = _mm256_mul_ps( _mm256_loadu_ps(s), _mm256_loadu_ps(h) );
+    for( int t=8; t < LOOP_SINC_TAPS; t+=8)
+      acc = _mm256_add_ps( acc, _mm256_mul_ps( _mm256_loadu_ps(s+t), _mm256_loadu_ps(h+t) ) );
+    __m128 a = _mm_add_ps( _mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc,1) );
+    a = _mm_add_ps( a, _mm_movehl_ps(a,a) );
+    a = _mm_add_ss( a, _mm_shuffle_ps(a,a,1) );
+    _mm_store_ss( out+i, a );
+  }
+}
+
+static const LoopKernels avx2Kernels = {
+  copyGainAVX2, copyGainRAVX2, addAVX2, addRAVX2, scaleAVX2, sumSquaresAVX2, dotAVX2, meterAVX2,
+  overdubAVX2, overdubRAVX2, mulAddAVX2, mixAVX2, panMixAVX2, fromIntAVX2, toIntAVX2, tpdfAVX2,
+  interpLinearAVX2, interpHermiteAVX2, interpSincAVX2, "avx2"
+};
+
+//cpu and os both have to support the 256 bit registers
+static bool hasAVX2(){
+  unsigned int a, b, c, d;
+  if( !__get_cpuid( 1, &a, &b, &c, &d ) ) return false;
+  if( !(c & bit_OSXSAVE) || !(c & bit_AVX) ) return false;
+  unsigned int xcr0, xcr0hi;
+  __asm__ ( "xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0) );
+  if( (xcr0 & 6) != 6 ) return false;
+  if( __get_cpuid_max( 0, 0 ) < 7 ) return false;
+  __cpuid_count( 7, 0, a, b, c, d );
+  return (b & bit_AVX2) != 0;
+}
+#endif
+
+#if JUCE_INTEL
+//always there on x86-64
+static bool hasSSE2(){
+ #if JUCE_64BIT
+  return true;
+ #else
+  return SystemStats::hasSSE2();
+ #endif
+}
+#endif
+
+
+#if JUCE_INTEL
+/*
+ * verification, every kernel has to reproduce the scalar output on odd sizes
+ * and misaligned pointers, sums of squares within rounding of the double sum
+ */
+static bool same( const float *a, const float *b, unsigned int n ){
+  return memcmp( a, b, n * sizeof(float) ) == 0;
+}
+
+static bool verify( const LoopKernels& k ){
+  const LoopKernels& s = scalarKernels;
+  const unsigned int size = 96;
+  float src[size], a[size], b[size], a2[size], b2[size];
+  Random rand(1234);
+  for( unsigned int i=0; i < size; i++) src[i] = rand.nextFloat() * 2.f - 1.f;
+
+  for( unsigned int n=0; n <= 67; n++){
+    for( unsigned int off=0; off < 4; off++){
+      const float *in = src + off;
+      const float *inR = src + off + n + 8;
+      float g = 0.3f + n * 0.01f;
+
+      for( unsigned int i=0; i < size; i++) a[i] = b[i] = src[size-1-i];
+      s.copyGain( a+off, in, g, n ); k.copyGain( b+off, in, g, n );
+      if( !same(a,b,size) ) return false;
+      s.copyGainR( a+off, inR, g, n ); k.copyGainR( b+off, inR, g, n );
+      if( !same(a,b,size) ) return false;
+      s.add( a+off, in, n ); k.add( b+off, in, n );
+      if( !same(a,b,size) ) return false;
+      s.addR( a+off+n+8, in, n ); k.addR( b+off+n+8, in, n );
+      if( !same(a,b,size) ) return false;
+      s.scale( a+off, g, n ); k.scale( b+off, g, n );
+      if( !same(a,b,size) ) return false;
+
+      for( unsigned int i=0; i < size; i++) a2[i] = b2[i] = src[i] * 0.5f;
+      s.overdub( a2, a+off, in, g, 0.7f, n ); k.overdub( b2, b+off, in, g, 0.7f, n );
+      if( !same(a,b,size) || !same(a2,b2,size) ) return false;
+      s.overdubR( a2, a+off+n+8, in, g, 0.7f, n ); k.overdubR( b2, b+off+n+8, in, g, 0.7f, n );
+      if( !same(a,b,size) || !same(a2,b2,size) ) return false;
+      s.mulAdd( a+off, in, inR - n, n ); k.mulAdd( b+off, in, inR - n, n );
+      if( !same(a,b,size) ) return false;
+      s.mix( a+off, in, g, n ); k.mix( b+off, in, g, n );
+      if( !same(a,b,size) ) return false;
+      s.panMix( a+off, a2+off, in, g, 1.f-g, n ); k.panMix( b+off, b2+off, in, g, 1.f-g, n );
+      if( !same(a,b,size) || !same(a2,b2,size) ) return false;
+      int ints[size];
+      for( unsigned int i=0; i < size; i++) ints[i] = (int)( src[i] * 2147483000.f );
+      s.fromInt( a+off, ints+off, 1.f / 2147483648.f, n ); k.fromInt( b+off, ints+off, 1.f / 2147483648.f, n );
+      if( !same(a,b,size) ) return false;
+      int ints2[size];
+      s.toInt( ints+off, in, inR - n, 32768.f, 16, n ); k.toInt( ints2+off, in, inR - n, 32768.f, 16, n );
+      if( memcmp( ints+off, ints2+off, n * sizeof(int) ) ) return false;
+      s.toInt( ints+off, in, 0, 8388608.f, 8, n ); k.toInt( ints2+off, in, 0, 8388608.f, 8, n );
+      if( memcmp( ints+off, ints2+off, n * sizeof(int) ) ) return false;
+      uint32 sa[LOOP_DITHER_LANES], sb[LOOP_DITHER_LANES];
+      for( unsigned int j=0; j < LOOP_DITHER_LANES; j++) sa[j] = sb[j] = 0x9e3779b9u * (j + n + 1) | 1;
+      s.tpdf( a+off, sa, n ); k.tpdf( b+off, sb, n );
+      if( !same(a,b,size) || memcmp( sa, sb, sizeof(sa) ) ) return false;
+
+      double x = s.sumSquares( in, n ), y = k.sumSquares( in, n );
+      if( fabs(x-y) > 1e-9 * (1.0 + fabs(x)) ) return false;
+      x = s.dot( in, inR - n, n ); y = k.dot( in, inR - n, n );
+      if( fabs(x-y) > 1e-9 * (1.0 + fabs(x)) ) return false;
+      float px = 0.25f, py = 0.25f;
+      x = s.meter( in, n, &px ); y = k.meter( in, n, &py );
+      if( fabs(x-y) > 1e-9 * (1.0 + fabs(x)) || px != py ) return false;
+    }
+  }
+
+  //resamplers over a range of speeds and start phases, sinc sums in a different order
+  float wide[512];
+  for( unsigned int i=0; i < 512; i++) wide[i] = rand.nextFloat() * 2.f - 1.f;
+  const double speeds[] = { 0.25, 0.7371, 1.0, 1.5, 3.99 };
+  for( unsigned int sp=0; sp < 5; sp++){
+    uint64 step = (uint64)( speeds[sp] * 4294967296.0 );
+    for( unsigned int n=0; n <= 67; n++){
+      uint64 phase = ((uint64)LOOP_INTERP_HALO << 32) + (uint64)n * 0x2f3a1b7bu;
+      s.interpLinear( a, wide, phase, step, n ); k.interpLinear( b, wide, phase, step, n );
+      if( !same(a,b,n) ) return false;
+      s.interpHermite( a, wide, phase, step, n ); k.interpHermite( b, wide, phase, step, n );
+      if( !same(a,b,n) ) return false;
+      s.interpSinc( a, wide, phase, step, n ); k.interpSinc( b, wide, phase, step, n );
+      for( unsigned int i=0; i < n; i++)
+        if( fabsf(a[i]-b[i]) > 1e-5f * (1.f + fabsf(a[i])) ) return false;
+    }
+  }
+  return true;
+}
+#endif
+
+static const LoopKernels& selectKernels(){
+ #if LOOP_KERNELS_AVX2
+  if( hasAVX2() ){
+    if( verify(avx2Kernels) ) return avx2Kernels;
+    std::cout << "loop kernels: avx2 failed verification" << std::endl;
+  }
+ #endif
+ #if JUCE_INTEL
+  if( hasSSE2() ){
+    if( verify(sse2Kernels) ) return sse2Kernels;
+    std::cout << "loop kernels: sse2 failed verification" << std::endl;
+  }
+ #endif
+  return scalarKernels;
+}
+
+const LoopKernels& getLoopKernels(){
+  static const LoopKernels& k = selectKernels();
+  return k;
+}
+
+const LoopKernels& getScalarLoopKernels(){
+  return scalarKernels;
+}
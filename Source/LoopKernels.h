@@ -0,0 +1,73 @@
+
+#ifndef _LOOPKERNELS_H_
+#define _LOOPKERNELS_H_
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//windowed sinc interpolator, taps per output (a multiple of 8) and phases in its table
+#define LOOP_SINC_TAPS 16
+#define LOOP_SINC_PHASE_BITS 9
+//samples an interpolator reads either side of the one it is at
+#define LOOP_INTERP_HALO (LOOP_SINC_TAPS/2)
+//generators side by side in the dither state, one per lane of the widest kernel
+#define LOOP_DITHER_LANES 8
+
+// inner loops of LoopBuffer and Loop over contiguous sample spans.
+// one table per instruction set, picked at startup for the running cpu.
+// reversed variants walk the buffer side backwards: element i is at p[-i]
+struct LoopKernels {
+
+  //dst[i] = src[i] * gain
+  void (*copyGain)( float *dst, const float *src, float gain, unsigned int n );
+  //dst[i] = src[-i] * gain
+  void (*copyGainR)( float *dst, const float *src, float gain, unsigned int n );
+  //dst[i] += src[i]
+  void (*add)( float *dst, const float *src, unsigned int n );
+  //dst[-i] += src[i]
+  void (*addR)( float *dst, const float *src, unsigned int n );
+  //dst[i] *= gain
+  void (*scale)( float *dst, float gain, unsigned int n );
+  //sum of src[i]^2
+  double (*sumSquares)( const float *src, unsigned int n );
+  //sum of a[i]*b[i], products rounded to float like sumSquares
+  double (*dot)( const float *a, const float *b, unsigned int n );
+  //sum of src[i]^2 as above, and *peak = max( *peak, |src[i]| ) in the same pass
+  double (*meter)( const float *src, unsigned int n, float *peak );
+  //out[i] = buf[i] * gain, buf[i] = buf[i] * decay + in[i] in one pass
+  void (*overdub)( float *out, float *buf, const float *in, float gain, float decay, unsigned int n );
+  //out[i] = buf[-i] * gain, buf[-i] = buf[-i] * decay + in[i]
+  void (*overdubR)( float *out, float *buf, const float *in, float gain, float decay, unsigned int n );
+  //dst[i] += a[i] * b[i]
+  void (*mulAdd)( float *dst, const float *a, const float *b, unsigned int n );
+  //dst[i] += src[i] * gain
+  void (*mix)( float *dst, const float *src, float gain, unsigned int n );
+  //outL[i] += src[i] * l, outR[i] += src[i] * r
+  void (*panMix)( float *outL, float *outR, const float *src, float l, float r, unsigned int n );
+  //dst[i] = src[i] * scale, decoded integer samples to float. dst may be src
+  void (*fromInt)( float *dst, const int *src, float scale, unsigned int n );
+  //dst[i] = round( src[i] * scale + dither[i] ) << shift, clamped to -scale..scale-1
+  //first. samples for a writer of 32 - shift bits, at most 24. dither may be 0
+  void (*toInt)( int *dst, const float *src, const float *dither, float scale, unsigned int shift, unsigned int n );
+  //triangular dither for toInt, dst[i] = (u - v) / 65536 for two 16 bit uniforms
+  //drawn from xorshift32 generator i % LOOP_DITHER_LANES of state, none of them 0
+  void (*tpdf)( float *dst, uint32 *state, unsigned int n );
+
+  //resampling of a contiguous span, the phase is 32.32 fixed point in samples of src
+  //and advances by step per output. src needs LOOP_INTERP_HALO samples around every
+  //position read. out[i] = src at phase + i*step
+  void (*interpLinear)( float *out, const float *src, uint64 phase, uint64 step, unsigned int n );
+  //4 point cubic hermite
+  void (*interpHermite)( float *out, const float *src, uint64 phase, uint64 step, unsigned int n );
+  //LOOP_SINC_TAPS point blackman windowed sinc, nearest of 2^LOOP_SINC_PHASE_BITS phases
+  void (*interpSinc)( float *out, const float *src, uint64 phase, uint64 step, unsigned int n );
+
+  const char *name;
+};
+
+//kernels for this cpu, verified against the scalar versions on first use
+const LoopKernels& getLoopKernels();
+
+//plain C++ reference implementation
+const LoopKernels& getScalarLoopKernels();
+
+#endif
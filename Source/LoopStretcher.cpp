@@ -0,0 +1,145 @@
+#include <string.h>
+#include <math.h>
+
+#include "LoopStretcher.h"
+#include "LoopKernels.h"
+
+#define OVERLAP (LOOP_STRETCH_FRAME - LOOP_STRETCH_HOP)
+#define REGION (LOOP_STRETCH_FRAME + 2 * LOOP_STRETCH_TOLERANCE)
+
+LoopStretcher::LoopStretcher() : memory(0), window(0), region(0), natural(0), frame(0),
+  fifoSize(0), fifoCount(0), position(0.0), last(0), head(0), primed(false), reversed(false) {
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) ola[c] = fifo[c] = 0;
+}
+
+LoopStretcher::~LoopStretcher(){
+  if( memory ) delete[] memory;
+}
+
+void LoopStretcher::prepare( unsigned int blockSize ){
+  if( memory && blockSize + LOOP_STRETCH_HOP <= fifoSize ) return;
+  if( memory ) delete[] memory;
+  fifoSize = blockSize + LOOP_STRETCH_HOP;
+
+  memory = new float[ LOOP_STRETCH_FRAME + REGION + OVERLAP + LOOP_STRETCH_FRAME
+                      + LOOP_MAX_CHANNELS * (LOOP_STRETCH_FRAME + fifoSize) ];
+  float *p = memory;
+  window = p; p += LOOP_STRETCH_FRAME;
+  region = p; p += REGION;
+  natural = p; p += OVERLAP;
+  frame = p; p += LOOP_STRETCH_FRAME;
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++){
+    ola[c] = p; p += LOOP_STRETCH_FRAME;
+    fifo[c] = p; p += fifoSize;
+  }
+
+  //periodic hann, overlapped at half a frame it sums to one
+  for( unsigned int i=0; i < LOOP_STRETCH_FRAME; i++)
+    window[i] = (float)( 0.5 - 0.5 * cos( 2.0 * double_Pi * i / LOOP_STRETCH_FRAME ) );
+  primed = false;
+}
+
+//count samples in playback order from first, wrapping in the bounds
+void LoopStretcher::fetch( LoopBuffer& b, unsigned int c, float *dst, int64 first, unsigned int count ){
+  if( reversed ) b.gatherR( c, dst, first, count );
+  else b.gather( c, dst, first, count );
+}
+
+void LoopStretcher::start( LoopBuffer& b, bool reverse ){
+  reversed = reverse;
+  unsigned int pos = b.rPos;
+  if( pos < b.rMin || pos > b.rMax ) pos = reverse ? b.rMax : b.rMin;
+  //reversed, the head is one past the next sample as for readR
+  position = reverse ? (double)pos - 1 : (double)pos;
+  if( position >= b.rMax ) position = b.rMin;
+  if( position < b.rMin ) position = b.rMax - 1;
+  //so the first frame continues from where the head is
+  last = (int64)position - (reverse ? -LOOP_STRETCH_HOP : LOOP_STRETCH_HOP);
+
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) zeromem( ola[c], LOOP_STRETCH_FRAME * sizeof(float) );
+  fifoCount = 0;
+  primed = true;
+}
+
+//normalised cross correlation of the candidate at offset with the natural continuation
+double LoopStretcher::score( unsigned int offset ){
+  const LoopKernels& k = getLoopKernels();
+  return k.dot( region + offset, natural, OVERLAP ) / sqrt( k.sumSquares( region + offset, OVERLAP ) + 1e-9 );
+}
+
+//offset into region of the best candidate, ties go to the ideal position
+unsigned int LoopStretcher::search(){
+  const int tolerance = LOOP_STRETCH_TOLERANCE, stride = LOOP_STRETCH_SEARCH_STRIDE;
+  int best = tolerance;
+  double bestScore = score( best );
+  for( int j = 0; j <= 2 * tolerance; j += stride){
+    double s = score( j );
+    if( s > bestScore ){ bestScore = s; best = j; }
+  }
+  int coarse = best;
+  for( int j = jmax( 0, coarse - stride + 1 ); j <= jmin( 2 * tolerance, coarse + stride - 1 ); j++){
+    if( j == coarse ) continue;
+    double s = score( j );
+    if( s > bestScore ){ bestScore = s; best = j; }
+  }
+  return (unsigned int)best;
+}
+
+void LoopStretcher::nextFrame( LoopBuffer& b, double hop ){
+  const LoopKernels& k = getLoopKernels();
+  const int dir = reversed ? -1 : 1;
+
+  //candidates ideal + dir*j for j in -tolerance..tolerance, in playback order
+  int64 ideal = (int64)floor( position + 0.5 );
+  int64 first = ideal - dir * LOOP_STRETCH_TOLERANCE;
+  fetch( b, 0, region, first, REGION );
+  fetch( b, 0, natural, last + dir * LOOP_STRETCH_HOP, OVERLAP );
+  unsigned int offset = search();
+  int64 cut = first + dir * (int64)offset;
+
+  for( unsigned int c=0; c < b.numChannels; c++){
+    const float *src = region + offset;
+    if( c > 0 ){
+      fetch( b, c, frame, cut, LOOP_STRETCH_FRAME );
+      src = frame;
+    }
+    k.mulAdd( ola[c], src, window, LOOP_STRETCH_FRAME );
+
+    //the first hop has all its frames now
+    memcpy( fifo[c] + fifoCount, ola[c], LOOP_STRETCH_HOP * sizeof(float) );
+    memmove( ola[c], ola[c] + LOOP_STRETCH_HOP, OVERLAP * sizeof(float) );
+    zeromem( ola[c] + OVERLAP, LOOP_STRETCH_HOP * sizeof(float) );
+  }
+  fifoCount += LOOP_STRETCH_HOP;
+  last = cut;
+
+  //advance the analysis position, wrapping inside the bounds
+  double len = b.rMax - b.rMin;
+  position += dir * hop;
+  if( position >= b.rMax ){
+    double wraps = floor( (position - b.rMin) / len );
+    position -= wraps * len;
+    b.times += (int)wraps;
+  }else if( position < b.rMin ){
+    double wraps = ceil( (b.rMin - position) / len );
+    position += wraps * len;
+    b.times += (int)wraps;
+  }
+  b.rPos = (unsigned int)position + (reversed ? 1 : 0);
+  b.rFrac = 0;
+}
+
+void LoopStretcher::process( LoopBuffer& b, float **out, unsigned int numSamples, double stretch, bool reverse ){
+  if( !memory || b.rMax <= b.rMin || numSamples + LOOP_STRETCH_HOP > fifoSize ) return;
+  if( !primed || reverse != reversed || b.rPos != head ) start( b, reverse );
+
+  double hop = LOOP_STRETCH_HOP / jlimit( LOOP_MIN_STRETCH, LOOP_MAX_STRETCH, stretch );
+  while( fifoCount < numSamples ) nextFrame( b, hop );
+
+  for( unsigned int c=0; c < b.numChannels; c++){
+    memcpy( out[c], fifo[c], numSamples * sizeof(float) );
+    memmove( fifo[c], fifo[c] + numSamples, (fifoCount - numSamples) * sizeof(float) );
+  }
+  fifoCount -= numSamples;
+  head = b.rPos;
+}
@@ -0,0 +1,60 @@
+
+#ifndef _LOOPSTRETCHER_H_
+#define _LOOPSTRETCHER_H_
+
+#include "LoopBuffer.h"
+
+//frame length, synthesis hop and alignment search range of the stretcher, in samples
+#define LOOP_STRETCH_FRAME 1024
+#define LOOP_STRETCH_HOP (LOOP_STRETCH_FRAME/2)
+#define LOOP_STRETCH_TOLERANCE 256
+//the search tries every this many offsets, then refines around the best
+#define LOOP_STRETCH_SEARCH_STRIDE 4
+
+//stretch range, as output duration over loop duration
+#define LOOP_MIN_STRETCH 0.25
+#define LOOP_MAX_STRETCH 4.0
+
+// time stretch without pitch change by waveform similarity overlap-add (wsola).
+// hann frames are laid down every LOOP_STRETCH_HOP output samples and cut from
+// the loop every LOOP_STRETCH_HOP / stretch samples, each cut moved by up to
+// LOOP_STRETCH_TOLERANCE to line up with the natural continuation of the frame
+// before. the search runs on the first channel and every channel is cut at the
+// same place, so stereo stays put. all memory is allocated in prepare.
+class LoopStretcher {
+public:
+
+  LoopStretcher();
+  ~LoopStretcher();
+
+  //allocate for blocks up to blockSize, not while the device runs
+  void prepare( unsigned int blockSize );
+  //start again from the read head on the next process
+  void reset(){ primed = false; }
+
+  //numSamples of b's channels stretched by stretch, forward or reversed.
+  //b's read head follows the analysis position and wraps count in b.times
+  void process( LoopBuffer& b, float **out, unsigned int numSamples, double stretch, bool reverse );
+
+private:
+  float *memory;
+  float *window, *region, *natural, *frame;
+  float *ola[LOOP_MAX_CHANNELS], *fifo[LOOP_MAX_CHANNELS];
+  unsigned int fifoSize, fifoCount;
+
+  double position; //ideal analysis position, inside the bounds
+  int64 last; //where the last frame was cut
+  unsigned int head; //b.rPos when process last returned, to notice rewinds
+  bool primed, reversed;
+
+  void start( LoopBuffer& b, bool reverse );
+  void nextFrame( LoopBuffer& b, double hop );
+  void fetch( LoopBuffer& b, unsigned int c, float *dst, int64 first, unsigned int count );
+  unsigned int search();
+  double score( unsigned int offset );
+
+  LoopStretcher( const LoopStretcher& );
+  LoopStretcher& operator=( const LoopStretcher& );
+};
+
+#endif
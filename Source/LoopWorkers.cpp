@@ -0,0 +1,188 @@
+#include "LoopWorkers.h"
+#include "LoopKernels.h"
+
+#if JUCE_MAC || JUCE_IOS
+ #include <mach/mach.h>
+#elif JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <semaphore.h>
+#endif
+
+LoopWorkers::Semaphore::Semaphore(){
+#if JUCE_MAC || JUCE_IOS
+  semaphore_t *s = new semaphore_t;
+  semaphore_create( mach_task_self(), s, SYNC_POLICY_FIFO, 0 );
+  handle = s;
+#elif JUCE_WINDOWS
+  handle = CreateSemaphore( 0, 0, 0x7fffffff, 0 );
+#else
+  sem_t *s = new sem_t;
+  sem_init( s, 0, 0 );
+  handle = s;
+#endif
+}
+
+LoopWorkers::Semaphore::~Semaphore(){
+#if JUCE_MAC || JUCE_IOS
+  semaphore_destroy( mach_task_self(), *(semaphore_t*)handle );
+  delete (semaphore_t*)handle;
+#elif JUCE_WINDOWS
+  CloseHandle( (HANDLE)handle );
+#else
+  sem_destroy( (sem_t*)handle );
+  delete (sem_t*)handle;
+#endif
+}
+
+void LoopWorkers::Semaphore::post(){
+#if JUCE_MAC || JUCE_IOS
+  semaphore_signal( *(semaphore_t*)handle );
+#elif JUCE_WINDOWS
+  ReleaseSemaphore( (HANDLE)handle, 1, 0 );
+#else
+  sem_post( (sem_t*)handle );
+#endif
+}
+
+void LoopWorkers::Semaphore::wait(){
+#if JUCE_MAC || JUCE_IOS
+  semaphore_wait( *(semaphore_t*)handle );
+#elif JUCE_WINDOWS
+  WaitForSingleObject( (HANDLE)handle, INFINITE );
+#else
+  while( sem_wait( (sem_t*)handle ) != 0 ){} //interrupted by a signal
+#endif
+}
+
+LoopWorkers::LoopWorkers() : busSize(0), loops(0), numIn(0), numOut(0), count(0) {
+  for( unsigned int c=0; c < LOOP_MAX_CHANNELS; c++) in[c] = 0;
+}
+
+LoopWorkers::~LoopWorkers(){
+  stop();
+}
+
+void LoopWorkers::stop(){
+  for( unsigned int w=0; w < workers.size(); w++) workers[w]->signalThreadShouldExit();
+  //a spare post, a helper about to park still wakes and sees it should exit
+  for( unsigned int w=0; w < workers.size(); w++){
+    workers[w]->wake.post();
+    delete workers[w];
+  }
+  workers.clear();
+}
+
+void LoopWorkers::prepare( unsigned int numThreads, unsigned int blockSize ){
+  numThreads = jmin( numThreads, (unsigned int)LOOP_MAX_WORKERS );
+  if( numThreads == workers.size() && blockSize <= busSize ) return;
+  stop();
+  busSize = blockSize;
+  for( unsigned int w=0; w < numThreads; w++) workers.push_back( new Worker( *this, w + 1, blockSize ) );
+}
+
+LoopWorkers::Worker::Worker( LoopWorkers& owner_, unsigned int index_, unsigned int blockSize )
+  : Thread("LoopWorker"), owner(owner_), index(index_) {
+  started.set( owner.generation.get() );
+  done.set( owner.generation.get() );
+  bus[0] = new float[ blockSize * LOOP_MAX_CHANNELS ];
+  for( unsigned int c=1; c < LOOP_MAX_CHANNELS; c++) bus[c] = bus[0] + c * blockSize;
+  //just under the audio callback
+  startThread(9);
+}
+
+LoopWorkers::Worker::~Worker(){
+  stopThread(1000);
+  delete[] bus[0];
+}
+
+void LoopWorkers::Worker::run(){
+  int seen = owner.generation.get();
+  int spins = 0;
+  while( !threadShouldExit() ){
+    int g = owner.generation.get();
+    if( g == seen ){
+      if( ++spins < LOOP_WORKER_SPIN ) continue;
+      //the audio thread posts only to a helper it finds parked, and unparks it
+      //as it does. one that unparks itself first was not posted to
+      parked.set(1);
+      if( owner.generation.get() == seen || !parked.compareAndSetBool( 0, 1 ) ) wake.wait();
+      spins = 0;
+      continue;
+    }
+    seen = g;
+    spins = 0;
+    started.set( g );
+
+    //a copy, the audio thread moves on without this helper if it is late
+    float *in[LOOP_MAX_CHANNELS];
+    unsigned int numIn = owner.numIn, numOut = owner.numOut, count = owner.count;
+    for( unsigned int c=0; c < numIn; c++) in[c] = owner.in[c];
+    for( unsigned int c=0; c < numOut; c++) zeromem( bus[c], count * sizeof(float) );
+    owner.renderShare( index, g, in, numIn, bus, numOut, count );
+    done.set( g );
+  }
+}
+
+//a loop is taken for at most one pass, never one before the last it was
+//taken for, and not while it is still being rendered for an earlier one
+bool LoopWorkers::take( Loop *l, int g ){
+  uint32 t = l->turn.get(), want = (uint32)g * 2;
+  if( ( t & 1 ) || (int32)( want - t ) <= 0 ) return false;
+  return l->turn.compareAndSetBool( want + 1, t );
+}
+
+void LoopWorkers::renderLoop( Loop *l, int g, float **in, unsigned int numIn,
+                              float **out, unsigned int numOut, unsigned int count ){
+  if( !take( l, g ) ) return;
+  if( !l->recording || !l->recOut ) l->audioIO( in, numIn, out, numOut, count );
+  l->turn.set( (uint32)g * 2 );
+}
+
+void LoopWorkers::renderShare( unsigned int index, int g, float **in, unsigned int numIn,
+                               float **out, unsigned int numOut, unsigned int count ){
+  std::vector<Loop*>& l = *loops;
+  unsigned int n = size();
+  for( unsigned int i=index; i < l.size(); i += n) renderLoop( l[i], g, in, numIn, out, numOut, count );
+}
+
+void LoopWorkers::render( std::vector<Loop*>& loops_, float **in_, unsigned int numIn_,
+                          float **out, unsigned int numOut_, unsigned int count_ ){
+  loops = &loops_;
+  numIn = numIn_;
+  numOut = numOut_;
+  count = count_;
+  for( unsigned int c=0; c < numIn; c++) in[c] = in_[c];
+  int g = ++generation;
+
+  //not worth waking anyone, or the block does not fit the buses. loops a late
+  //helper still has are skipped here as well
+  if( workers.empty() || loops_.size() < 2 || count > busSize || numOut > LOOP_MAX_CHANNELS ){
+    for( unsigned int i=0; i < loops_.size(); i++) renderLoop( loops_[i], g, in, numIn, out, numOut, count );
+    return;
+  }
+
+  for( unsigned int w=0; w < workers.size(); w++)
+    if( workers[w]->parked.compareAndSetBool( 0, 1 ) ) workers[w]->wake.post();
+
+  renderShare( 0, g, in, numIn, out, numOut, count );
+
+  //whatever helpers have not taken by the first limit is rendered here. a helper
+  //that has not even started can take nothing after that and is not waited for,
+  //one not done by the second limit is left behind with its bus
+  const int64 start = Time::getHighResolutionTicks();
+  const double ticks = Time::getHighResolutionTicksPerSecond() / 1000000.0;
+  const int64 wait = start + (int64)( LOOP_WORKER_WAIT * ticks );
+  const int64 deadline = start + (int64)( LOOP_WORKER_DEADLINE * ticks );
+  for( unsigned int w=0; w < workers.size(); w++){
+    while( workers[w]->done.get() != g && Time::getHighResolutionTicks() < wait ){}
+    if( workers[w]->done.get() != g ) renderShare( w + 1, g, in, numIn, out, numOut, count );
+  }
+  const LoopKernels& k = getLoopKernels();
+  for( unsigned int w=0; w < workers.size(); w++){
+    if( workers[w]->started.get() != g ) continue;
+    while( workers[w]->done.get() != g && Time::getHighResolutionTicks() < deadline ){}
+    if( workers[w]->done.get() != g ) continue;
+    for( unsigned int c=0; c < numOut; c++) k.add( out[c], workers[w]->bus[c], count );
+  }
+}
@@ -0,0 +1,99 @@
+
+#ifndef _LOOPWORKERS_H_
+#define _LOOPWORKERS_H_
+
+#include <vector>
+
+#include "LoopBuffer.h"
+
+//most helper threads, and how many polls a helper spins for the next block before it sleeps
+#define LOOP_MAX_WORKERS 8
+#define LOOP_WORKER_SPIN 20000
+//microseconds the audio thread waits, after its own share, before it renders the
+//loops no helper has taken yet, and before it leaves a helper still rendering behind
+#define LOOP_WORKER_WAIT 100
+#define LOOP_WORKER_DEADLINE 1000
+
+// renders the loops of one audio block on several cores. the helper threads
+// are spawned in prepare and loop i always goes to worker i % size(), the
+// audio thread being worker 0 and mixing straight into out. the others mix
+// into their own bus, added to out in worker order once all are done, so a
+// block sums the same way every time. helpers spin for a while after a block
+// and then park until the audio thread posts their semaphore, which never
+// locks.
+//
+// every render pass has a generation, and a loop is taken for one by moving
+// its turn there (Loop::turn), whoever renders it. the audio thread never waits
+// without a limit: loops no helper has taken within LOOP_WORKER_WAIT it renders
+// itself into out, and a helper not done by LOOP_WORKER_DEADLINE is left
+// behind, its bus dropped for the pass. the one loop it is still in the middle
+// of stays with it, lent() until it is done, and is skipped until then
+class LoopWorkers {
+public:
+
+  LoopWorkers();
+  ~LoopWorkers();
+
+  //numThreads helpers with buses for blocks up to blockSize, not while the device runs.
+  //0 stops them all and render just runs on the calling thread
+  void prepare( unsigned int numThreads, unsigned int blockSize );
+  unsigned int size() const { return workers.size() + 1; }
+
+  //Loop::audioIO of every loop that is not recording the output, mixed into out.
+  //audio thread only
+  void render( std::vector<Loop*>& loops, float **in, unsigned int numIn,
+               float **out, unsigned int numOut, unsigned int count );
+  //whether a helper left behind is still rendering l, the audio thread leaves it alone then
+  static bool lent( Loop *l ){ return ( l->turn.get() & 1 ) != 0; }
+
+private:
+  //posted by the audio thread, so no mutex
+  class Semaphore {
+  public:
+    Semaphore();
+    ~Semaphore();
+    void post();
+    void wait();
+  private:
+    void *handle;
+  };
+
+  class Worker : public Thread {
+  public:
+    Worker( LoopWorkers& owner, unsigned int index, unsigned int blockSize );
+    ~Worker();
+    void run();
+
+    LoopWorkers& owner;
+    unsigned int index;
+    float *bus[LOOP_MAX_CHANNELS];
+    Atomic<int> parked;
+    Atomic<int> started, done; //generation of the last pass it took up, and went through its share of
+    Semaphore wake;
+  };
+
+  std::vector<Worker*> workers;
+  unsigned int busSize;
+
+  //the pass being rendered, set before generation moves on. a helper that
+  //takes a loop has read these before the audio thread could change them
+  std::vector<Loop*> *loops;
+  float *in[LOOP_MAX_CHANNELS];
+  unsigned int numIn, numOut, count;
+  Atomic<int> generation;
+
+  //take l for pass g, false if it is taken already or still lent
+  static bool take( Loop *l, int g );
+  //l into out if nobody has taken it for pass g yet
+  static void renderLoop( Loop *l, int g, float **in, unsigned int numIn,
+                          float **out, unsigned int numOut, unsigned int count );
+  //the loops of share index that nobody has taken yet, into out
+  void renderShare( unsigned int index, int g, float **in, unsigned int numIn,
+                    float **out, unsigned int numOut, unsigned int count );
+  void stop();
+
+  LoopWorkers( const LoopWorkers& );
+  LoopWorkers& operator=( const LoopWorkers& );
+};
+
+#endif
@@ -1,17 +1,41 @@
 
 #include "Looper.h"
+#include "LoopKernels.h"
+#include "LoopStretcher.h"
+#include "LooperBroadcast.h"
+#include "LooperTransfer.h"
+#include "LooperShared.h"
 
 #define BOUND(x) if((x)<0||(x)>=loops.size()) return
 #define abs(x) ((x)<0?(-(x)):(x))
-Looper::Looper(){}
+Looper::Looper( unsigned int poolMegabytes ) :
+    pool( poolMegabytes * (1024 * 1024 / LOOP_CHUNK_BYTES), LOOPER_POOL_LOW_WATERMARK ),
+    sampleRate(44100), blockSize(512), commands(1024), spent(1024), arrivals(0), now(0), sharing(0), epoch(0.0) {
+    events.reserve( LOOPER_MAX_EVENTS );
+    deferred.reserve( LOOPER_MAX_EVENTS );
+    reserve = jmin( (unsigned int)( LOOPER_POOL_RESERVE_MB * (1024 * 1024 / LOOP_CHUNK_BYTES) ), pool.capacity() / 4 );
+    //the calendar clock only has milliseconds, so read it once and go on the tick counter
+    startTicks = Time::getHighResolutionTicks();
+    startSeconds = Time::currentTimeMillis() * 0.001 + 2208988800.0; //unix to ntp epoch
+    epochs.write() = 0.0;
+    epochs.publish();
+    //pick and verify the sample kernels now rather than on the audio thread
+    getLoopKernels();
+    workers.prepare( SystemStats::getNumCpus() - 1, blockSize );
+}
 
 Looper::~Looper(){
+    collect();
     for(int i=0; i < loops.size(); i++)
         delete loops[i];
 }
 
-Loop* Looper::newLoop(){
+Loop* Looper::newLoop( unsigned int channels ){
     Loop *loop = new Loop();
+    loop->setPool( &pool );
+    loop->b.reserveChannels( channels );
+    loop->setChannels( channels );
+    loop->prepareToPlay( sampleRate, blockSize );
     loops.push_back( loop );
     loudness.push_back( 0.f );
     return loop;
@@ -22,77 +46,551 @@ Loop* Looper::operator()(int loop){
     return loops[loop];
 }
 
+size_t Looper::memoryUsed(int i){
+    if(i < 0 || i >= loops.size() ) return 0;
+    return loops[i]->memoryUsed();
+}
+
+//the pool's two counts move apart for a moment while it refills, never past its budget
+unsigned int Looper::spareChunks() const {
+    unsigned int free = pool.capacity() - jmin( pool.used(), pool.capacity() );
+    return free > reserve ? free - reserve : 0;
+}
+
+void Looper::prepareToPlay( unsigned int rate, unsigned int blockSize_ ){
+    sampleRate = rate;
+    blockSize = blockSize_;
+    epoch = 0.0; //the mapping starts over at the new rate
+    for( int i=0; i < loops.size(); i++)
+        loops[i]->prepareToPlay( rate, blockSize );
+    //one core is the audio thread itself
+    workers.prepare( SystemStats::getNumCpus() - 1, blockSize );
+}
+
+const LoopMeter& Looper::meter(int i){
+    return loops[i]->meter[0].read();
+}
+
+const LoopMeter& Looper::remoteMeter(int i){
+    return loops[i]->meter[1].read();
+}
+
+const LoopMeter& Looper::sessionMeter(int i){
+    return loops[i]->meter[2].read();
+}
+
+const LoopMeter& Looper::importMeter(int i){
+    return loops[i]->meter[3].read();
+}
+
+const LooperMeter& Looper::masterMeter(){
+    return master.read();
+}
+
 void Looper::updateRMS(){
     for( int i=0; i < loops.size(); i++){
-        Loop* l = loops[i];
+        const LoopMeter& m = meter(i);
         float loud = loudness[i];
-        l->rms = l->b[0].getRMSR( 2048 );
-        if( l->rms > .5f ){
-            loud += l->rms;
+        if( m.rms > .5f ){
+            loud += m.rms;
             if(loud > 100.f) loud = 100.f;
         }else{
-            loud -= .6f - l->rms;
+            loud -= .6f - m.rms;
             if( loud < 0.f) loud = 0.f;
         }
-        if( loud > 3.f && l->gain > .05f ){
-            l->gain -= .05f;
-            if(l->gain <= 0.f) l->gain = 0.f;
+        if( loud > 3.f && m.gain > .05f ){
+            setGain(i, m.gain - .05f);
             //loud -= 1.f;
-        }else if( loud < .1f && l->gain < 1.f ){
-            l->gain += .001f;
+        }else if( loud < .1f && m.gain < 1.f ){
+            setGain(i, m.gain + .001f);
         }
         loudness[i] = loud;
     }
 }
-void Looper::play(int i){ BOUND(i); loops[i]->play(); }
-void Looper::playOnce(int i){ 
-    BOUND(i);
-    Loop *l = loops[i];
-    l->times = 1;
-    l->rewind();
-    l->play();
-}
-void Looper::stop(int i){ BOUND(i); loops[i]->stop(); }
-void Looper::stack(int i){ BOUND(i); loops[i]->stack(); }
-void Looper::reverse(int i){ BOUND(i); loops[i]->reverse(); }
-void Looper::clear(int i){ BOUND(i); loops[i]->clear(); }
-void Looper::setGain(int i, float g){ BOUND(i); if(g < 0.f) g = 0.f; loops[i]->gain = g; }
-void Looper::setDecay(int i, float g){ BOUND(i); if(g < 0.f) g = 0.f; loops[i]->decay = g; }
-void Looper::record(int i){ 
-    BOUND(i);
-    Loop *l = loops[i];
-    l->clear();
-    l->stop();
-    l->record(); 
+void Looper::send(int type, int i, float value, float value2){
+    schedule( 0, type, i, value, value2 );
 }
 
-void Looper::toggleRecord(int i){
+void Looper::schedule(int64 time, int type, int i, float value, float value2){
     BOUND(i);
-    Loop *l = loops[i];
-    if(!l->recording){
-		int sampleRate = 44100; //audioDeviceManager.getCurrentAudioDevice()->getCurrentSampleRate();
-		if( l->numSamples == 0 ){
-            l->allocate( sampleRate * 5.f );
-        }else l->clear();
-        l->stop();
-        l->record();
-	}else{
-        l->stop();
-		l->rewind();
-        l->play();
-	}
-}
-
-void Looper::audioIO( float** in, float** out, unsigned int count ){
+    //chunk tables are allocated here, the audio thread only switches over
+    if( type == LooperCommand::SetChannels ){
+        value = jlimit( 1.f, (float)LOOP_MAX_CHANNELS, value );
+        loops[i]->b.reserveChannels( (unsigned int)value );
+    }
+    LooperCommand c;
+    c.type = type;
+    c.loop = i;
+    c.value = value;
+    c.value2 = value2;
+    c.time = time;
+    c.order = 0;
+    c.image = 0;
+    if( !commands.push(c) ) std::cout << "looper command queue full, dropped command" << std::endl;
+}
+
+void Looper::load(int i, LoopImage *image, int64 time){ post( LooperCommand::Load, i, image, time ); }
+void Looper::extend(int i, LoopImage *image){ post( LooperCommand::Extend, i, image, 0 ); }
+
+void Looper::post(int type, int i, LoopImage *image, int64 time){
+    collect();
+    if( i < 0 || i >= loops.size() ){ delete image; return; }
+    loops[i]->b.reserveChannels( image->numChannels );
+    LooperCommand c;
+    c.type = type;
+    c.loop = i;
+    c.value = c.value2 = 0.f;
+    c.time = time;
+    c.order = 0;
+    c.image = image;
+    if( !commands.push(c) ){
+        std::cout << "looper command queue full, dropped command" << std::endl;
+        delete image;
+    }
+}
+
+//the reader's side of Loop::hold, one reader per loop at a time. the copy is good
+//if the pin was not lost while it was made. with the device stopped nothing
+//writes, the live layer is copied and good if the clock still stands
+//copies the held layer out for snapshot
+struct LoopLayerCopy : LoopLayerReader {
+    HeapBlock<float>& data;
+    unsigned int &channels, &size;
+    LoopLayerCopy( HeapBlock<float>& data_, unsigned int& channels_, unsigned int& size_ )
+        : data(data_), channels(channels_), size(size_) {}
+    bool read( const LoopLayer& layer, unsigned int channels_, unsigned int size_ ){
+        channels = channels_;
+        size = size_;
+        data.malloc( channels * size );
+        for( unsigned int first=0; first < size; first += LOOP_CHUNK_SIZE){
+            unsigned int n = jmin( size - first, (unsigned int)LOOP_CHUNK_SIZE );
+            for( unsigned int c=0; c < channels; c++)
+                memcpy( data + c * size + first, layer.chunks[c][ first >> LOOP_CHUNK_BITS ], n * sizeof(float) );
+        }
+        return true;
+    }
+};
+
+bool Looper::snapshot(int i, HeapBlock<float>& data, unsigned int& channels, unsigned int& size, int timeout){
+    LoopLayerCopy copy( data, channels, size );
+    return readHeld( i, copy, timeout );
+}
+
+bool Looper::readHeld(int i, LoopLayerReader& reader, int timeout){
+    if( i < 0 || i >= loops.size() ) return false;
+    LoopBuffer& b = loops[i]->b;
+    const ScopedLock sl( b.pinLock );
+    uint32 started = Time::getMillisecondCounter();
+    for(;;){
+        uint32 asked = b.pins.get();
+        int64 clock_ = clock();
+        send( LooperCommand::Hold, i );
+        uint32 since = Time::getMillisecondCounter();
+        while( b.pins.get() == asked && Time::getMillisecondCounter() - since < LOOPER_HOLD_SETTLE
+               && Time::getMillisecondCounter() - started < (uint32)timeout ){
+            Thread::sleep( LOOPER_HOLD_POLL );
+            if( clock() != clock_ ){ clock_ = clock(); since = Time::getMillisecondCounter(); }
+        }
+        uint32 held = b.pins.get();
+        bool stopped = held == asked && clock() == clock_;
+        int slot = stopped ? (int)b.liveSlot : b.pinnedSlot;
+        unsigned int channels = stopped ? b.numChannels : b.pinnedChannels;
+        unsigned int size = stopped ? b.curSize : b.pinnedSize;
+
+        bool good = false, given = false;
+        if( (held != asked || stopped) && slot >= 0 && size > 0 ){
+            given = !reader.read( b.layers[slot], channels, size );
+            good = !given && ( stopped ? clock() == clock_ : b.pins.get() == held );
+        }
+        //the hold is let go of even if it was not answered yet, it is then undone
+        //as soon as it is applied
+        send( LooperCommand::Unhold, i );
+        if( good ) return true;
+        if( given || size == 0 || Time::getMillisecondCounter() - started >= (uint32)timeout ) return false;
+        Thread::sleep( LOOPER_HOLD_POLL );
+    }
+}
+
+void Looper::collect(){
+    LoopImage *image;
+    while( spent.pop( image ) ) delete image;
+}
+
+void Looper::play(int i){ send( LooperCommand::Play, i ); }
+void Looper::playOnce(int i){ send( LooperCommand::PlayOnce, i ); }
+void Looper::stop(int i){ send( LooperCommand::Stop, i ); }
+void Looper::togglePlay(int i){ send( LooperCommand::TogglePlay, i ); }
+void Looper::stack(int i){ send( LooperCommand::Stack, i ); }
+void Looper::reverse(int i){ send( LooperCommand::Reverse, i ); }
+void Looper::rewind(int i){ send( LooperCommand::Rewind, i ); }
+void Looper::clear(int i){ send( LooperCommand::Clear, i ); }
+void Looper::setGain(int i, float g){ send( LooperCommand::SetGain, i, g ); }
+void Looper::setDecay(int i, float g){ send( LooperCommand::SetDecay, i, g ); }
+void Looper::setPan(int i, float p){ send( LooperCommand::SetPan, i, p ); }
+void Looper::setBounds(int i, float min, float max){ send( LooperCommand::SetBounds, i, min, max ); }
+void Looper::setRecordOutput(int i, bool b){ send( LooperCommand::SetRecordOutput, i, b ? 1.f : 0.f ); }
+void Looper::setSpeed(int i, float s){ send( LooperCommand::SetSpeed, i, s ); }
+void Looper::setInterpolation(int i, int mode){ send( LooperCommand::SetInterpolation, i, (float)mode ); }
+void Looper::undo(int i){ send( LooperCommand::Undo, i ); }
+void Looper::redo(int i){ send( LooperCommand::Redo, i ); }
+void Looper::setUndoMemory(int i, float megabytes){ send( LooperCommand::SetUndoMemory, i, megabytes ); }
+void Looper::setStretch(int i, float s){ send( LooperCommand::SetStretch, i, s ); }
+void Looper::fitLength(int i, float seconds){ send( LooperCommand::FitLength, i, seconds ); }
+void Looper::setChannels(int i, unsigned int n){ send( LooperCommand::SetChannels, i, (float)n ); }
+void Looper::record(int i){ send( LooperCommand::Record, i ); }
+void Looper::toggleRecord(int i){ send( LooperCommand::ToggleRecord, i ); }
+
+//audio thread
+void Looper::apply(const LooperCommand& c){
+    Loop *l = loops[c.loop];
+    switch( c.type ){
+        case LooperCommand::Play: l->play(); break;
+        case LooperCommand::PlayOnce:
+            l->rewind();
+            l->play(1);
+            break;
+        case LooperCommand::Stop: l->stop(); break;
+        case LooperCommand::Record:
+            l->clear();
+            l->stop();
+            l->record();
+            break;
+        case LooperCommand::ToggleRecord:
+            if(!l->recording){
+                l->clear();
+                l->stop();
+                l->record();
+            }else{
+                l->stop();
+                l->rewind();
+                l->play();
+            }
+            break;
+        case LooperCommand::TogglePlay: l->playing = !l->playing && l->numSamples; break;
+        case LooperCommand::Stack: l->stack(); break;
+        case LooperCommand::Reverse: l->reverse(); break;
+        case LooperCommand::Rewind: l->rewind(); break;
+        case LooperCommand::Clear: l->clear(); break;
+        case LooperCommand::SetGain: l->gain = c.value < 0.f ? 0.f : c.value; break;
+        case LooperCommand::SetDecay: l->decay = c.value < 0.f ? 0.f : c.value; break;
+        case LooperCommand::SetPan: l->pan = c.value < 0.f ? 0.f : (c.value > 1.f ? 1.f : c.value); break;
+        case LooperCommand::SetBounds:
+            l->b.setBounds( c.value * l->b.curSize, c.value2 * l->b.curSize );
+            break;
+        case LooperCommand::SetRecordOutput: l->recOut = c.value != 0.f; break;
+        case LooperCommand::SetChannels: l->setChannels( (unsigned int)c.value ); break;
+        case LooperCommand::SetSpeed: l->speed = jlimit( LOOP_MIN_SPEED, LOOP_MAX_SPEED, (double)c.value ); break;
+        case LooperCommand::SetInterpolation: l->interpolation = (int)c.value; break;
+        case LooperCommand::SetStretch:
+            l->stretch = jlimit( LOOP_MIN_STRETCH, LOOP_MAX_STRETCH, (double)c.value );
+            l->fitLength = 0;
+            break;
+        case LooperCommand::Undo: l->undo(); break;
+        case LooperCommand::Redo: l->redo(); break;
+        case LooperCommand::SetUndoMemory: l->setHistoryLimit( (unsigned int)(c.value * (1024 * 1024 / LOOP_CHUNK_BYTES)) ); break;
+        case LooperCommand::Load:
+        case LooperCommand::Extend:
+            if( c.type == LooperCommand::Load ) l->load( *c.image );
+            else l->extend( *c.image );
+            spent.push( c.image ); //as deep as the command queue, only full if collect never runs
+            break;
+        case LooperCommand::FitLength: l->fitLength = c.value > 0.f ? (unsigned int)(c.value * sampleRate) : 0; break;
+        case LooperCommand::Hold: l->hold(); break;
+        case LooperCommand::Unhold: l->unhold(); break;
+    }
+}
+
+//top of the heap is the earliest event, first come first served on a tie
+struct EventLater {
+    bool operator()( const LooperCommand& a, const LooperCommand& b ) const {
+        return a.time != b.time ? a.time > b.time : (int32)(a.order - b.order) > 0;
+    }
+};
+
+double Looper::wallClock() const {
+    return startSeconds + (Time::getHighResolutionTicks() - startTicks) / (double)Time::getHighResolutionTicksPerSecond();
+}
+
+int64 Looper::sampleAtSeconds(double s){
+    double e = epochs.read();
+    if( e == 0.0 ) return 0;
+    return (int64)floor( (s - e) * sampleRate + 0.5 );
+}
+
+int64 Looper::sampleAt(uint64 timeTag){
+    return sampleAtSeconds( (double)(timeTag >> 32) + (double)(timeTag & 0xffffffff) / 4294967296.0 );
+}
+
+//a packet that came in during a block is applied as far into the one after
+int64 Looper::sampleAtArrival(double arrival){
+    int64 t = sampleAtSeconds( arrival + 2208988800.0 );
+    return t ? t + blockSize : 0;
+}
+
+//the block is rendered in pieces, each event applied on the sample it is due
+void Looper::audioIO( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ){
     
-	for(int i=0; i < loops.size(); i++ ){
-        Loop *l = loops[i];
-        if( !l->recording || !l->recOut ) loops[i]->audioIO( in, out, count );
+    //callbacks come in late by varying amounts, follow their average
+    double e = wallClock() - (double)now / sampleRate;
+    epoch = epoch == 0.0 ? e : epoch + (e - epoch) * LOOPER_CLOCK_SMOOTHING;
+    epochs.write() = epoch;
+    epochs.publish();
+    
+    //a loop still lent to a render helper is late for the whole block, whatever
+    //is due for it waits behind what already waits
+    unsigned int kept = 0;
+    for( unsigned int i=0; i < loops.size(); i++) loops[i]->late = LoopWorkers::lent( loops[i] );
+    for( unsigned int i=0; i < deferred.size(); i++){
+        if( loops[deferred[i].loop]->late ) deferred[kept++] = deferred[i];
+        else apply( deferred[i] );
+    }
+    deferred.resize( kept );
+    
+    LooperCommand c;
+    while( events.size() + deferred.size() < LOOPER_MAX_EVENTS && commands.pop(c) ){
+        if( c.time < now ) c.time = now;
+        c.order = arrivals++;
+        events.push_back(c);
+        std::push_heap( events.begin(), events.end(), EventLater() );
+    }
+    
+    if( !in ) numIn = 0;
+    if( !out ) numOut = 0;
+    numIn = jmin( numIn, (unsigned int)LOOP_MAX_CHANNELS );
+    numOut = jmin( numOut, (unsigned int)LOOP_MAX_CHANNELS );
+    float *in2[LOOP_MAX_CHANNELS], *out2[LOOP_MAX_CHANNELS];
+    
+    unsigned int done = 0;
+    while( done < count ){
+        while( !events.empty() && events.front().time <= now + done ){
+            Loop *l = loops[events.front().loop];
+            if( l->late || LoopWorkers::lent( l ) ){
+                l->late = true;
+                deferred.push_back( events.front() );
+            }else apply( events.front() );
+            std::pop_heap( events.begin(), events.end(), EventLater() );
+            events.pop_back();
+        }
+        unsigned int next = count;
+        if( !events.empty() && events.front().time < now + count ) next = (unsigned int)(events.front().time - now);
         
+        for( unsigned int ch=0; ch < numIn; ch++) in2[ch] = in[ch] + done;
+        for( unsigned int ch=0; ch < numOut; ch++) out2[ch] = out[ch] + done;
+        render( in2, numIn, out2, numOut, next - done );
+        done = next;
+    }
+    now += count;
+    sampleClock.set( now );
+    
+    LooperMeter& m = master.write();
+    const LoopKernels& k = getLoopKernels();
+    m.numChannels = numOut;
+    for( unsigned int ch=0; ch < numOut; ch++){
+        m.peak[ch] = 0.f;
+        m.rms[ch] = count ? sqrtf( (float)(k.meter( out[ch], count, &m.peak[ch] ) / count) ) : 0.f;
     }
+    publishShared( m );
+    master.publish();
+}
+
+void Looper::share(LooperSharedSegment *segment){
+    //fails while the audio thread holds the old one, until it puts it back
+    while( !shared.compareAndSetBool( segment, sharing ) ) Thread::sleep(1);
+    sharing = segment;
+}
+
+void Looper::publishShared( const LooperMeter& m ){
+    LooperSharedSegment *s = shared.exchange( 0 );
+    if( !s ) return;
+    uint32 seq = s->sequence.get();
+    s->sequence.set( seq + 1 );
+    LooperSharedState& state = s->state;
+    state.clock = now;
+    state.sampleRate = sampleRate;
+    state.numLoops = jmin( (unsigned int)loops.size(), (unsigned int)LOOPER_SHARED_LOOPS );
+    state.master = m;
+    for( unsigned int i=0; i < state.numLoops; i++)
+        if( !LoopWorkers::lent( loops[i] ) ) state.loops[i] = loops[i]->lastMeter;
+    s->sequence.set( seq + 2 );
+    shared.set( s );
+}
+
+void Looper::render( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ){
+    //loops recording the output go after the mix is complete
+    workers.render( loops, in, numIn, out, numOut, count );
     for(int i=0; i < loops.size(); i++ ){
         Loop *l = loops[i];
-        if( l->recording && l->recOut ) loops[i]->audioIO( out, 0, count );
+        if( l->recording && l->recOut && !LoopWorkers::lent( l ) ) loops[i]->audioIO( out, numOut, 0, 0, count );
     }
     
-}  
+}
+
+LooperOSC::LooperOSC(Looper* looper_) : looper(looper_), bundleTime(1), arrival(0.), handlers(this), session(this), time(0), loop(-1), sender(0) {
+    handlers.bind( "/play", &LooperOSC::command<LooperCommand::Play> );
+    handlers.bind( "/playOnce", &LooperOSC::command<LooperCommand::PlayOnce> );
+    handlers.bind( "/stop", &LooperOSC::command<LooperCommand::Stop> );
+    handlers.bind( "/record", &LooperOSC::command<LooperCommand::Record> );
+    handlers.bind( "/toggleRecord", &LooperOSC::command<LooperCommand::ToggleRecord> );
+    handlers.bind( "/stack", &LooperOSC::command<LooperCommand::Stack> );
+    handlers.bind( "/reverse", &LooperOSC::command<LooperCommand::Reverse> );
+    handlers.bind( "/clear", &LooperOSC::command<LooperCommand::Clear> );
+    handlers.bind( "/undo", &LooperOSC::command<LooperCommand::Undo> );
+    handlers.bind( "/redo", &LooperOSC::command<LooperCommand::Redo> );
+    handlers.bind( "/gain", &LooperOSC::value<LooperCommand::SetGain> );
+    handlers.bind( "/decay", &LooperOSC::value<LooperCommand::SetDecay> );
+    handlers.bind( "/stretch", &LooperOSC::value<LooperCommand::SetStretch> );
+    handlers.bind( "/fitLength", &LooperOSC::value<LooperCommand::FitLength> );
+    handlers.bind( "/channels", &LooperOSC::value<LooperCommand::SetChannels> );
+    handlers.build();
+    session.bind( "/subscribe", &LooperOSC::subscribe );
+    session.bind( "/unsubscribe", &LooperOSC::unsubscribe );
+    session.bind( "/broadcast/rate", &LooperOSC::broadcastRate );
+    session.bind( "/broadcast/multicast", &LooperOSC::multicast );
+    session.bind( "/loop/upload/begin", &LooperOSC::beginUpload );
+    session.bind( "/loop/upload", &LooperOSC::upload );
+    session.bind( "/loop/upload/end", &LooperOSC::endUpload );
+    session.bind( "/loop/download", &LooperOSC::download );
+    session.bind( "/loop/download/resend", &LooperOSC::resend );
+    session.build();
+    for( int i=0; i < LOOPER_OSC_PATTERN_CACHE; i++) patterns[i].numLoops = 0;
+    broadcast = new LooperBroadcast( looper );
+    transfer = new LooperTransfer( looper );
+}
+
+LooperOSC::~LooperOSC(){
+    delete broadcast;
+    delete transfer;
+}
+
+void LooperOSC::subscribe( osc::int32 port ){
+    broadcast->subscribe( IpEndpointName( sender->address, port > 0 ? port : sender->port ) );
+}
+
+void LooperOSC::unsubscribe( osc::int32 port ){
+    broadcast->unsubscribe( IpEndpointName( sender->address, port > 0 ? port : sender->port ) );
+}
+
+void LooperOSC::broadcastRate( float hz ){ broadcast->setRate( hz ); }
+
+void LooperOSC::multicast( const char *group, osc::int32 port ){
+    IpEndpointName to;
+    if( *group && port > 0 ) to = IpEndpointName( group, port );
+    if( !broadcast->setMulticast( to ) ) std::cout << "not a multicast group: " << group << "\n";
+}
+
+void LooperOSC::beginUpload( osc::int32 i, osc::int32 frames, osc::int32 channels ){
+    transfer->beginUpload( *sender, i, frames, channels );
+}
+
+void LooperOSC::upload( osc::int32 i, osc::int32 offset, osc::Blob blob ){
+    transfer->upload( *sender, i, offset, blob.data, blob.size );
+}
+
+void LooperOSC::endUpload( osc::int32 i ){ transfer->endUpload( *sender, i ); }
+void LooperOSC::download( osc::int32 i ){ transfer->download( *sender, i, 0, -1 ); }
+
+void LooperOSC::resend( osc::int32 i, osc::int32 first, osc::int32 count ){
+    transfer->download( *sender, i, first, jmax( count, 0 ) );
+}
+
+//only malformed packets throw, in oscpack's parsing
+void LooperOSC::ProcessPacket( const char *data, int size, const IpEndpointName& remoteEndpoint, double arrival_ ){
+    arrival = arrival_;
+    try{
+        osc::OscPacketListener::ProcessPacket( data, size, remoteEndpoint );
+    }catch( osc::Exception& e ){
+        std::cout << "malformed osc packet: " << e.what() << "\n";
+    }
+    arrival = 0.;
+}
+
+void LooperOSC::error( const osc::ReceivedMessage& m, const char *what ){
+    std::cout << "error while parsing message: " << m.AddressPattern() << ": " << what << "\n";
+}
+
+void LooperOSC::ProcessMessage( const osc::ReceivedMessage& m, const IpEndpointName& remoteEndpoint ){
+    const char *address = m.AddressPattern();
+    const char *tags = m.TypeTags();
+    osc::ReceivedMessageArgumentIterator args = m.ArgumentsBegin();
+    time = 0;
+    if( bundleTime > 1 ) time = looper->sampleAt( bundleTime );
+    else if( arrival > 0. ) time = looper->sampleAtArrival( arrival );
+    
+    int g = session.find( address );
+    if( g >= 0 ){
+        sender = &remoteEndpoint;
+        if( session.call( g, tags, args ) != OscCalled ) error( m, "wrong arguments" );
+        sender = 0;
+        return;
+    }
+    
+    //the loop is in the address or the first argument
+    loop = -1;
+    const char *command = address;
+    if( strncmp( address, "/loop/", 6 ) == 0 ){
+        char *end;
+        loop = (int)strtol( address + 6, &end, 10 );
+        command = end;
+        if( end == address + 6 || *end != '/' ){ loop = -1; command = address; }
+    }
+    
+    if( !OscPattern::isPattern( address ) ){
+        int h = handlers.find( command );
+        if( h < 0 ) return;
+        if( command == address ){
+            if( !tags || *tags != 'i' ) return error( m, "expected the loop index" );
+            loop = args->AsInt32Unchecked();
+            ++args; ++tags;
+        }
+        if( handlers.call( h, tags, args ) != OscCalled ) error( m, "wrong arguments" );
+        return;
+    }
+    
+    const Fanout& f = fanout( address );
+    if( f.targets.empty() ) return;
+    //the pattern either names loops or takes the index, never both
+    int id = -1;
+    if( f.targets[0].loop < 0 ){
+        if( !tags || *tags != 'i' ) return error( m, "expected the loop index" );
+        id = args->AsInt32Unchecked();
+        ++args; ++tags;
+    }
+    //targets whose arguments differ are skipped, /loop/1/* with a float only sets values
+    bool called = false;
+    for( unsigned int i=0; i < f.targets.size(); i++){
+        loop = f.targets[i].loop < 0 ? id : f.targets[i].loop;
+        called |= handlers.call( f.targets[i].command, tags, args ) == OscCalled;
+    }
+    if( !called ) error( m, "wrong arguments" );
+}
+
+//each pattern is compiled and run against the address space once, until it falls
+//out of the cache or loops are added
+const LooperOSC::Fanout& LooperOSC::fanout( const char *pattern ){
+    unsigned int numLoops = looper->loops.size();
+    uint32 h = 2166136261u;
+    for( const char *p = pattern; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+    Fanout& f = patterns[ h % LOOPER_OSC_PATTERN_CACHE ];
+    if( f.numLoops == numLoops && f.pattern == pattern ) return f;
+    
+    f.pattern = pattern;
+    f.numLoops = numLoops;
+    f.targets.clear();
+    OscPattern p;
+    if( !p.compile( pattern ) ) return f;
+    
+    Target t;
+    if( strncmp( pattern, "/loop/", 6 ) == 0 ){
+        char address[256];
+        for( t.loop = 0; t.loop < (int)numLoops; t.loop++)
+            for( t.command = 0; t.command < (int)handlers.size(); t.command++){
+                snprintf( address, sizeof(address), "/loop/%d%s", t.loop, handlers.address( t.command ) );
+                if( p.matches( address ) ) f.targets.push_back(t);
+            }
+    }else{
+        t.loop = -1;
+        for( t.command = 0; t.command < (int)handlers.size(); t.command++)
+            if( p.matches( handlers.address( t.command ) ) ) f.targets.push_back(t);
+    }
+    return f;
+}
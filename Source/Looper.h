@@ -4,80 +4,265 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <string.h>
 
 #include "LoopBuffer.h"
+#include "LockFreeQueue.h"
+#include "SamplePool.h"
+#include "LoopWorkers.h"
+#include "OscDispatch.h"
+
+//sample memory budget shared by all loops, and the amount kept ready for the audio thread
+#define LOOPER_POOL_MB 256
+#define LOOPER_POOL_LOW_WATERMARK 64
+//of the budget, what uploads and imports leave for recording. at most a quarter of it
+#define LOOPER_POOL_RESERVE_MB 32
+//commands held by the audio thread waiting for their time
+#define LOOPER_MAX_EVENTS 1024
+//how fast the mapping from wall clock to sample clock follows each callback's timing
+#define LOOPER_CLOCK_SMOOTHING 0.01
+//ms between looks while a snapshot waits for the audio thread, and how long the
+//sample clock may stand still before the device counts as stopped
+#define LOOPER_HOLD_POLL 2
+#define LOOPER_HOLD_SETTLE 200
 
 #include "osc/OscReceivedElements.h"
 #include "osc/OscPacketListener.h"
 
 
+class LooperBroadcast;
+class LooperTransfer;
+struct LooperSharedSegment;
+
+// reads a layer of a loop that the audio thread holds still, see Looper::readHeld
+struct LoopLayerReader {
+    virtual ~LoopLayerReader(){}
+    //channels by size samples of layer, which stays as it is until this returns.
+    //asked again if the hold was lost meanwhile, false gives up
+    virtual bool read( const LoopLayer& layer, unsigned int channels, unsigned int size ) = 0;
+};
+
+//output mix levels of the last callback, per device channel
+struct LooperMeter {
+    unsigned int numChannels;
+    float rms[LOOP_MAX_CHANNELS], peak[LOOP_MAX_CHANNELS];
+};
+
+// control change for one loop, queued by the gui / osc threads and
+// applied by the audio thread on the sample of its time, or at the start
+// of the next block when that has passed
+struct LooperCommand {
+    enum Type { Play, PlayOnce, Stop, Record, ToggleRecord, TogglePlay,
+                Stack, Reverse, Rewind, Clear,
+                SetGain, SetDecay, SetPan, SetBounds, SetRecordOutput, SetChannels,
+                SetSpeed, SetInterpolation, SetStretch, FitLength,
+                Undo, Redo, SetUndoMemory, Load, Extend, Hold, Unhold };
+    int type;
+    int loop;
+    float value, value2;
+    LoopImage *image; //for Load and Extend, owned by the looper once queued
+    int64 time; //on Looper::clock(), 0 for as soon as possible
+    uint32 order; //arrival, breaks ties between equal times
+};
+
 struct Looper {
   
+    SamplePool pool;
     std::vector<Loop*> loops;
     std::vector<float> loudness;
 
-  unsigned int sampleRate;
+  unsigned int sampleRate, blockSize;
 
-  Looper();
+  Looper( unsigned int poolMegabytes = LOOPER_POOL_MB );
   ~Looper();
     
-    Loop* newLoop();
+    //called before the device starts, sizes per loop scratch buffers and the render workers
+    void prepareToPlay( unsigned int rate, unsigned int blockSize );
+    
+    Loop* newLoop( unsigned int channels = 1 );
     Loop* operator()(int loop);
+    size_t memoryUsed(int i);
+    //pool chunks an upload or import may still take, short of the recording reserve
+    unsigned int spareChunks() const;
     
+    //latest meters published by the audio thread, gui thread only
+    const LoopMeter& meter(int i);
+    //the same for the osc broadcast thread, for session saves and for imports (one at a time
+    //each), and the output mix
+    const LoopMeter& remoteMeter(int i);
+    const LoopMeter& sessionMeter(int i);
+    const LoopMeter& importMeter(int i);
+    const LooperMeter& masterMeter();
     void updateRMS();
     
+    //control thread interface, safe to call from any thread but the audio callback
     void play(int i);
     void playOnce(int i);    
     void stop(int i);
     void record(int i);
     void toggleRecord(int i);
+    void togglePlay(int i);
     void stack(int i);
     void reverse(int i);
+    void rewind(int i);
     void clear(int i);
+    void undo(int i);
+    void redo(int i);
+    void setUndoMemory(int i, float megabytes); //cap on what each loop's history holds
     void setGain(int i, float g);
     void setDecay(int i, float g);    
+    void setPan(int i, float p);
+    void setBounds(int i, float min, float max); //fractions of recorded length
+    void setRecordOutput(int i, bool b);
+    void setChannels(int i, unsigned int n); //takes effect once the loop is empty
+    void setSpeed(int i, float s); //LOOP_MIN_SPEED to LOOP_MAX_SPEED, 1 is normal
+    void setInterpolation(int i, int mode); //LoopBuffer::Interpolation
+    void setStretch(int i, float s); //duration factor at the same pitch, 1 is off
+    void fitLength(int i, float seconds); //stretch the loop's bounds to seconds, 0 is off
+    //replace loop i's audio with image at time (0 as soon as possible). the looper
+    //deletes the image, on a later call from a control thread, never the audio thread
+    void load(int i, LoopImage *image, int64 time=0);
+    //a further piece of a loop loaded in pieces, see Loop::extend
+    void extend(int i, LoopImage *image);
+    //copy loop i as it is at one moment to data, planar at size per channel. the
+    //audio thread holds a layer still for it, see Loop::hold. false if the loop is
+    //empty, or could not be held within timeout ms, while it is recorded say
+    bool snapshot(int i, HeapBlock<float>& data, unsigned int& channels, unsigned int& size, int timeout);
+    //the same with what is done with the held layer up to reader
+    bool readHeld(int i, LoopLayerReader& reader, int timeout);
+    
+    //samples rendered since the device started, and any LooperCommand::Type at a
+    //sample of that clock. the block containing time is split there
+    int64 clock() const { return sampleClock.get(); }
+    void schedule(int64 time, int type, int i, float value=0.f, float value2=0.f);
+    //sample clock position of an osc / ntp time tag, 0 (as soon as possible) until the
+    //device has run. reads the mapping the audio thread keeps, one control thread only
+    int64 sampleAt(uint64 timeTag);
+    //for packets without a time tag: where in the next block a packet received at
+    //arrival (unix seconds) goes, so the delay from the wire is the same for all
+    int64 sampleAtArrival(double arrival);
+    
+    //have the audio thread publish state into segment after every callback, 0 to
+    //stop. returns once the audio thread has let go of the one before
+    void share(LooperSharedSegment *segment);
     
   
-  void audioIO( float** in, float** out, unsigned int count ); 
+  void audioIO( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count ); 
   
+private:
+    LockFreeQueue<LooperCommand> commands;
+    LockFreeQueue<LoopImage*> spent; //loaded images, their leftovers freed by collect()
+    LoopWorkers workers;
+    unsigned int reserve; //LOOPER_POOL_RESERVE_MB in chunks
+    
+    //audio thread side of the command queue, a heap on time then arrival
+    std::vector<LooperCommand> events;
+    //due for loops a render helper was left rendering, in order, applied once they are back
+    std::vector<LooperCommand> deferred;
+    uint32 arrivals;
+    int64 now;
+    Atomic<int64> sampleClock;
+    TripleBuffer<LooperMeter> master;
+    Atomic<LooperSharedSegment*> shared; //taken by the audio thread while it writes
+    LooperSharedSegment *sharing; //what share() last put there
+    //wall clock, as ntp seconds, of sample 0. follows the callbacks, smoothed
+    double epoch;
+    TripleBuffer<double> epochs;
+    int64 startTicks;
+    double startSeconds;
+    
+    double wallClock() const;
+    int64 sampleAtSeconds(double ntpSeconds);
+
+    void send(int type, int i, float value=0.f, float value2=0.f);
+    void collect();
+    void post(int type, int i, LoopImage *image, int64 time);
+    void apply(const LooperCommand& c);
+    void render( float** in, unsigned int numIn, float** out, unsigned int numOut, unsigned int count );
+    void publishShared( const LooperMeter& m );
 
 };
 
+//wildcard patterns remembered with the loops and commands they matched
+#define LOOPER_OSC_PATTERN_CACHE 64
+
+// osc control of a Looper. addresses are /<command> with the loop index as the
+// first argument, or /loop/<index>/<command>. either form can be an osc 1.0
+// pattern, /loop/*/gain sets every loop's gain. commands are typed handlers,
+// and patterns compiled once and cached with what they matched.
+// /stretch <factor> and /fitLength <seconds> change a loop's length at the
+// same pitch, see LoopStretcher. /channels <n> is what a loop records from its
+// next recording on.
+// /subscribe <port> has the sender sent loop state on that port, 0 for the
+// one it sent from, until /unsubscribe <port>. see LooperBroadcast.
+// /broadcast/rate <hz> sets how often it updates, /broadcast/multicast <group>
+// <port> sends it once to a multicast group instead, an empty group or port 0
+// goes back to each subscriber.
+// /loop/upload and /loop/download move loop audio, see LooperTransfer
 struct LooperOSC : public osc::OscPacketListener {
     Looper *looper;
-    LooperOSC(Looper* looper_){
-        looper = looper_;  
-    };
+    LooperBroadcast *broadcast;
+    LooperTransfer *transfer;
+    uint64 bundleTime; //time tag of the bundle being dispatched, 1 is immediately
+    double arrival; //kernel receive time of the packet, 0 if unknown
+    
+    LooperOSC(Looper* looper_);
+    ~LooperOSC();
+    
+    virtual void ProcessPacket( const char *data, int size,
+                               const IpEndpointName& remoteEndpoint ){
+        ProcessPacket( data, size, remoteEndpoint, 0. );
+    }
+    virtual void ProcessPacket( const char *data, int size,
+                               const IpEndpointName& remoteEndpoint, double arrival_ );
+    
+    //messages in a bundle are scheduled for its time tag, nested bundles use their own
+    virtual void ProcessBundle( const osc::ReceivedBundle& b,
+                               const IpEndpointName& remoteEndpoint ){
+        uint64 outer = bundleTime;
+        bundleTime = b.TimeTag();
+        osc::OscPacketListener::ProcessBundle( b, remoteEndpoint );
+        bundleTime = outer;
+    }
     
     virtual void ProcessMessage( const osc::ReceivedMessage& m, 
-                                const IpEndpointName& remoteEndpoint ){
-        try{
-            osc::ReceivedMessageArgumentStream args = m.ArgumentStream();
-            osc::int32 id;
-            args >> id;
-            
-            if( strcmp( m.AddressPattern(), "/play" ) == 0 ) looper->play(id);
-            if( strcmp( m.AddressPattern(), "/playOnce" ) == 0 ) looper->playOnce(id);
-            else if( strcmp( m.AddressPattern(), "/stop" ) == 0 ) looper->stop(id);
-            else if( strcmp( m.AddressPattern(), "/record" ) == 0 ) looper->record(id);
-            else if( strcmp( m.AddressPattern(), "/toggleRecord" ) == 0 ) looper->toggleRecord(id);
-            else if( strcmp( m.AddressPattern(), "/stack" ) == 0 ) looper->stack(id);
-            else if( strcmp( m.AddressPattern(), "/reverse" ) == 0 ) looper->reverse(id);
-            else if( strcmp( m.AddressPattern(), "/clear" ) == 0 ) looper->clear(id);
-            else if( strcmp( m.AddressPattern(), "/gain" ) == 0 ){
-                float gain;
-                args >> gain;
-                looper->setGain(id, gain);
-            } else if( strcmp( m.AddressPattern(), "/decay" ) == 0 ){
-                float decay;
-                args >> decay;
-                looper->setDecay(id, decay);
-            }
-        }catch( osc::Exception& e ){
-            std::cout << "error while parsing message: "
-            << m.AddressPattern() << ": " << e.what() << "\n";
-        }
-    };    
+                                const IpEndpointName& remoteEndpoint );
+    
+private:
+    OscHandlers<LooperOSC> handlers;
+    OscHandlers<LooperOSC> session; //addresses not about a loop
+    
+    //loop -1 takes the index from the arguments
+    struct Target { int loop, command; };
+    struct Fanout {
+        std::string pattern;
+        unsigned int numLoops; //matched against this many, stale once there are more
+        std::vector<Target> targets;
+    };
+    Fanout patterns[LOOPER_OSC_PATTERN_CACHE];
+    
+    const Fanout& fanout( const char *pattern );
+    
+    //the message being handled
+    int64 time;
+    int loop;
+    const IpEndpointName *sender;
+    
+    template <int type> void command(){ looper->schedule( time, type, loop ); }
+    template <int type> void value( float v ){ looper->schedule( time, type, loop, v ); }
+    
+    void subscribe( osc::int32 port );
+    void unsubscribe( osc::int32 port );
+    void broadcastRate( float hz );
+    void multicast( const char *group, osc::int32 port );
+    void beginUpload( osc::int32 i, osc::int32 frames, osc::int32 channels );
+    void upload( osc::int32 i, osc::int32 offset, osc::Blob blob );
+    void endUpload( osc::int32 i );
+    void download( osc::int32 i );
+    void resend( osc::int32 i, osc::int32 first, osc::int32 count );
+    
+    void error( const osc::ReceivedMessage& m, const char *what );
 };
 
 #endif
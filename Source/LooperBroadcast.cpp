@@ -0,0 +1,195 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+
+#include "LooperBroadcast.h"
+
+//smallest rms or peak change that goes out, about -80dB
+#define LOOPER_BROADCAST_LEVEL_STEP 1e-4f
+
+LooperBroadcast::LooperBroadcast( Looper *looper_ ) : Thread("LooperBroadcast"), looper(looper_),
+    refresh(false), lastRefresh(0), numBundles(0), numMessages(0) {
+  clients.reserve( LOOPER_MAX_SUBSCRIBERS );
+  period.set( 1000 / LOOPER_BROADCAST_RATE );
+  sentMaster.numChannels = 0;
+
+  memory = new char[ LOOPER_BROADCAST_BUNDLES * LOOPER_BROADCAST_MTU ];
+  for( int i=0; i < LOOPER_BROADCAST_BUNDLES; i++)
+    bundles[i] = new osc::OutboundPacketStream( memory + i * LOOPER_BROADCAST_MTU, LOOPER_BROADCAST_MTU );
+  destinations = new IpEndpointName[ LOOPER_BROADCAST_BUNDLES * LOOPER_MAX_SUBSCRIBERS ];
+  data = new const char*[ LOOPER_BROADCAST_BUNDLES * LOOPER_MAX_SUBSCRIBERS ];
+  sizes = new int[ LOOPER_BROADCAST_BUNDLES * LOOPER_MAX_SUBSCRIBERS ];
+
+  startThread(3);
+}
+
+LooperBroadcast::~LooperBroadcast(){
+  signalThreadShouldExit();
+  notify();
+  stopThread(1000);
+  for( int i=0; i < LOOPER_BROADCAST_BUNDLES; i++) delete bundles[i];
+  delete[] memory;
+  delete[] destinations;
+  delete[] data;
+  delete[] sizes;
+}
+
+void LooperBroadcast::subscribe( const IpEndpointName& client ){
+  const ScopedLock sl( lock );
+  if( std::find( clients.begin(), clients.end(), client ) == clients.end() ){
+    if( clients.size() >= LOOPER_MAX_SUBSCRIBERS ) return;
+    clients.push_back( client );
+  }
+  refresh = true;
+}
+
+void LooperBroadcast::unsubscribe( const IpEndpointName& client ){
+  const ScopedLock sl( lock );
+  clients.erase( std::remove( clients.begin(), clients.end(), client ), clients.end() );
+}
+
+bool LooperBroadcast::setMulticast( const IpEndpointName& group_, int timeToLive, bool loopback ){
+  if( group_.address != IpEndpointName::ANY_ADDRESS ){
+    if( ( group_.address >> 28 ) != 0xe ) return false; //224.0.0.0/4
+    try{
+      socket.SetMulticast( jlimit( 0, 255, timeToLive ), loopback );
+    }catch( std::runtime_error& ){
+      return false;
+    }
+  }
+  const ScopedLock sl( lock );
+  group = group_;
+  refresh = true;
+  return true;
+}
+
+void LooperBroadcast::setRate( float hz ){
+  period.set( jlimit( 1, 1000, (int)( 1000.f / jmax( hz, 0.001f ) ) ) );
+}
+
+void LooperBroadcast::run(){
+  while( !threadShouldExit() ){
+    wait( period.get() );
+    if( !threadShouldExit() ) update();
+  }
+}
+
+//starts a new bundle when the message would not fit the current one, false
+//once they are all used. sizes are worked out the way OutboundPacketStream
+//checks them, so it never throws
+bool LooperBroadcast::message( const char *address, unsigned int numArgs ){
+  unsigned int need = 4 + ((strlen( address ) + 4) & ~3u) + ((numArgs + 6) & ~3u) + 4 * numArgs;
+  if( numBundles == 0 || bundles[numBundles - 1]->Size() + need > LOOPER_BROADCAST_MTU ){
+    if( numBundles > 0 ) endBundle();
+    if( numBundles == LOOPER_BROADCAST_BUNDLES ) return false;
+    osc::OutboundPacketStream& p = *bundles[numBundles++];
+    p.Clear();
+    p << osc::BeginBundleImmediate;
+  }
+  *bundles[numBundles - 1] << osc::BeginMessage( address );
+  numMessages++;
+  return true;
+}
+
+void LooperBroadcast::endBundle(){
+  osc::OutboundPacketStream& p = *bundles[numBundles - 1];
+  if( p.IsBundleInProgress() ) p << osc::EndBundle;
+}
+
+void LooperBroadcast::update(){
+  IpEndpointName to[LOOPER_MAX_SUBSCRIBERS];
+  unsigned int numTo = 0;
+  bool full;
+  {
+    const ScopedLock sl( lock );
+    if( group.address != IpEndpointName::ANY_ADDRESS ) to[numTo++] = group;
+    else for( unsigned int i=0; i < clients.size(); i++) to[numTo++] = clients[i];
+    full = refresh;
+    refresh = false;
+  }
+  if( numTo == 0 ) return;
+  uint32 ms = Time::getMillisecondCounter();
+  if( ms - lastRefresh >= LOOPER_BROADCAST_REFRESH ) full = true;
+  if( full ) lastRefresh = ms;
+
+  numBundles = 0;
+  numMessages = 0;
+  char address[64];
+  unsigned int numLoops = looper->loops.size();
+  if( sent.size() < numLoops ) sent.resize( numLoops );
+
+  //a field is remembered as sent only once it is in a bundle
+  for( unsigned int i=0; i < numLoops; i++){
+    const LoopMeter& m = looper->remoteMeter(i);
+    LoopMeter& s = sent[i];
+    if( full || m.flags != s.flags ){
+      snprintf( address, sizeof(address), "/loop/%u/state", i );
+      if( !message( address, 1 ) ) break;
+      *bundles[numBundles - 1] << (osc::int32)m.flags << osc::EndMessage;
+      s.flags = m.flags;
+    }
+    if( full || m.rPos != s.rPos || m.rMin != s.rMin || m.rMax != s.rMax ){
+      snprintf( address, sizeof(address), "/loop/%u/position", i );
+      if( !message( address, 1 ) ) break;
+      float position = m.rMax > m.rMin ? (float)( m.rPos - m.rMin ) / ( m.rMax - m.rMin ) : 0.f;
+      *bundles[numBundles - 1] << position << osc::EndMessage;
+      s.rPos = m.rPos; s.rMin = m.rMin; s.rMax = m.rMax;
+    }
+    if( full || fabsf( m.rms - s.rms ) > LOOPER_BROADCAST_LEVEL_STEP ){
+      snprintf( address, sizeof(address), "/loop/%u/rms", i );
+      if( !message( address, 1 ) ) break;
+      *bundles[numBundles - 1] << m.rms << osc::EndMessage;
+      s.rms = m.rms;
+    }
+    if( full || m.gain != s.gain ){
+      snprintf( address, sizeof(address), "/loop/%u/gain", i );
+      if( !message( address, 1 ) ) break;
+      *bundles[numBundles - 1] << m.gain << osc::EndMessage;
+      s.gain = m.gain;
+    }
+    if( full || m.pan != s.pan ){
+      snprintf( address, sizeof(address), "/loop/%u/pan", i );
+      if( !message( address, 1 ) ) break;
+      *bundles[numBundles - 1] << m.pan << osc::EndMessage;
+      s.pan = m.pan;
+    }
+    if( full || m.decay != s.decay ){
+      snprintf( address, sizeof(address), "/loop/%u/decay", i );
+      if( !message( address, 1 ) ) break;
+      *bundles[numBundles - 1] << m.decay << osc::EndMessage;
+      s.decay = m.decay;
+    }
+  }
+
+  const LooperMeter& master = looper->masterMeter();
+  bool rmsChanged = full || master.numChannels != sentMaster.numChannels;
+  bool peakChanged = rmsChanged;
+  for( unsigned int c=0; c < master.numChannels && !rmsChanged; c++)
+    rmsChanged = fabsf( master.rms[c] - sentMaster.rms[c] ) > LOOPER_BROADCAST_LEVEL_STEP;
+  for( unsigned int c=0; c < master.numChannels && !peakChanged; c++)
+    peakChanged = fabsf( master.peak[c] - sentMaster.peak[c] ) > LOOPER_BROADCAST_LEVEL_STEP;
+  if( rmsChanged && message( "/master/rms", master.numChannels ) ){
+    osc::OutboundPacketStream& p = *bundles[numBundles - 1];
+    for( unsigned int c=0; c < master.numChannels; c++) p << master.rms[c];
+    p << osc::EndMessage;
+    memcpy( sentMaster.rms, master.rms, sizeof(master.rms) );
+    sentMaster.numChannels = master.numChannels;
+  }
+  if( peakChanged && message( "/master/peak", master.numChannels ) ){
+    osc::OutboundPacketStream& p = *bundles[numBundles - 1];
+    for( unsigned int c=0; c < master.numChannels; c++) p << master.peak[c];
+    p << osc::EndMessage;
+    memcpy( sentMaster.peak, master.peak, sizeof(master.peak) );
+  }
+
+  if( numMessages == 0 ) return;
+  endBundle();
+  unsigned int n = 0;
+  for( unsigned int d=0; d < numTo; d++)
+    for( unsigned int b=0; b < numBundles; b++, n++){
+      destinations[n] = to[d];
+      data[n] = bundles[b]->Data();
+      sizes[n] = bundles[b]->Size();
+    }
+  socket.SendMany( destinations, data, sizes, n );
+}
@@ -0,0 +1,75 @@
+
+#ifndef _LOOPERBROADCAST_H_
+#define _LOOPERBROADCAST_H_
+
+#include <vector>
+
+#include "Looper.h"
+#include "ip/UdpSocket.h"
+#include "osc/OscOutboundPacketStream.h"
+
+//updates per second, and the most clients that can subscribe
+#define LOOPER_BROADCAST_RATE 30
+#define LOOPER_MAX_SUBSCRIBERS 32
+//osc bytes per datagram, an ethernet frame less the ip and udp headers
+#define LOOPER_BROADCAST_MTU 1472
+//datagrams per update, what does not fit waits for the next one
+#define LOOPER_BROADCAST_BUNDLES 64
+//everything is sent again this often, for lost packets and new clients, in ms
+#define LOOPER_BROADCAST_REFRESH 2000
+//routers a multicast update may cross, 1 keeps it on the local network
+#define LOOPER_BROADCAST_TTL 1
+
+// sends loop state to subscribed osc clients: /loop/<i>/state (LoopMeter flags),
+// /loop/<i>/position (0-1 in the bounds), /loop/<i>/rms, /gain, /pan, /decay,
+// and /master/rms and /master/peak with a float per output channel. only what
+// changed since the last update goes out, packed into mtu sized bundles that
+// are built in buffers allocated up front and sent to all clients in one go.
+// with a multicast group set, each bundle is sent once to the group instead
+class LooperBroadcast : private Thread {
+public:
+
+  LooperBroadcast( Looper *looper );
+  ~LooperBroadcast();
+
+  //any thread. a new client gets the full state with the next update
+  void subscribe( const IpEndpointName& client );
+  void unsubscribe( const IpEndpointName& client );
+  //ANY_ADDRESS goes back to sending to each client. loopback has the group's
+  //members on this host hear it too. false if group is not a multicast address
+  //or the socket would not take the options
+  bool setMulticast( const IpEndpointName& group, int timeToLive = LOOPER_BROADCAST_TTL, bool loopback = true );
+  void setRate( float hz );
+
+private:
+  Looper *looper;
+  UdpSocket socket;
+
+  CriticalSection lock; //clients, group, refresh
+  std::vector<IpEndpointName> clients;
+  IpEndpointName group;
+  bool refresh;
+  Atomic<int> period; //ms
+  uint32 lastRefresh;
+
+  //what clients were last sent
+  std::vector<LoopMeter> sent;
+  LooperMeter sentMaster;
+
+  char *memory;
+  osc::OutboundPacketStream *bundles[LOOPER_BROADCAST_BUNDLES];
+  unsigned int numBundles, numMessages;
+  IpEndpointName *destinations;
+  const char **data;
+  int *sizes;
+
+  void run();
+  void update();
+  bool message( const char *address, unsigned int numArgs );
+  void endBundle();
+
+  LooperBroadcast( const LooperBroadcast& );
+  LooperBroadcast& operator=( const LooperBroadcast& );
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <vector>
+
+#include "LooperExport.h"
+#include "LoopKernels.h"
+
+LooperExport::LooperExport( Looper *looper_, int numThreads ) : looper(looper_), remaining(0), ready(false),
+    started(0), pool( jmax( 1, numThreads ) ) {
+  formats.registerBasicFormats();
+  pool.setThreadPriorities(3);
+  zerostruct( report );
+}
+
+LooperExport::~LooperExport(){
+  pool.removeAllJobs( true, 4000 );
+}
+
+int LooperExport::exportAll( const File& target, int bitsPerSample ){
+  AudioFormat *format = formats.findFormatForFileExtension( target.getFileExtension() );
+  if( !format || format->getPossibleBitDepths().size() == 0 ) format = formats.findFormatForFileExtension( ".wav" );
+  if( !format ) return 0;
+  String extension = target.getFileExtension().isEmpty() ? String(".wav") : target.getFileExtension();
+  bitsPerSample = bitsPerSample > 16 ? 24 : 16;
+
+  std::vector<int> loops;
+  for( int i=0; i < (int)looper->loops.size(); i++)
+    if( looper->meter(i).numSamples > 0 ) loops.push_back(i);
+  {
+    const ScopedLock sl( lock );
+    if( remaining > 0 || loops.empty() ) return 0;
+    zerostruct( report );
+    remaining = (int)loops.size();
+    ready = false;
+    started = Time::getMillisecondCounter();
+  }
+  for( unsigned int i=0; i < loops.size(); i++){
+    File file = target.getSiblingFile( target.getFileNameWithoutExtension() + "-" + String( loops[i] + 1 ).paddedLeft( '0', 2 ) + extension );
+    pool.addJob( new Job( *this, loops[i], file, format, bitsPerSample ), true );
+  }
+  return (int)loops.size();
+}
+
+String LooperExport::getWildcard(){
+  StringArray wildcards;
+  for( int i=0; i < formats.getNumKnownFormats(); i++){
+    AudioFormat *format = formats.getKnownFormat(i);
+    if( format->getPossibleBitDepths().size() == 0 ) continue;
+    const StringArray& extensions = format->getFileExtensions();
+    for( int j=0; j < extensions.size(); j++) wildcards.addIfNotAlreadyThere( "*" + extensions[j] );
+  }
+  return wildcards.joinIntoString( ";" );
+}
+
+bool LooperExport::takeReport( LooperExportReport& r ){
+  const ScopedLock sl( lock );
+  if( !ready ) return false;
+  r = report;
+  ready = false;
+  return true;
+}
+
+int64 LooperExport::write( Job& job, const float *data, unsigned int channels, unsigned int size ){
+  const LoopKernels& k = getLoopKernels();
+  //lossless formats write the bits asked for, dithered. the others take 32 bit
+  //ints, 24 of them are plenty
+  Array<int> depths = job.format->getPossibleBitDepths();
+  bool lossless = depths.contains( job.bitsPerSample );
+  int bits = lossless ? job.bitsPerSample : depths.getLast();
+  int kept = jmin( bits, 24 );
+  float scale = (float)(1 << (kept - 1));
+
+  TemporaryFile temp( job.file );
+  {
+    FileOutputStream *out = new FileOutputStream( temp.getFile() );
+    if( out->failedToOpen() ){
+      delete out;
+      return -1;
+    }
+    ScopedPointer<AudioFormatWriter> writer( job.format->createWriterFor( out, looper->sampleRate, channels, bits,
+      StringPairArray(), lossless ? 0 : LOOPER_EXPORT_QUALITY ) );
+    if( !writer ){
+      delete out;
+      return -1;
+    }
+
+    HeapBlock<int> ints( channels * LOOPER_EXPORT_BATCH );
+    HeapBlock<int*> planes;
+    planes.calloc( channels + 1 );
+    for( unsigned int c=0; c < channels; c++) planes[c] = ints + c * LOOPER_EXPORT_BATCH;
+    HeapBlock<float> dither( LOOPER_EXPORT_BATCH );
+    uint32 state[LOOP_DITHER_LANES], seed = 0x9e3779b9u * (job.loop + 1);
+    for( unsigned int j=0; j < LOOP_DITHER_LANES; j++){
+      seed = seed * 1664525u + 1013904223u;
+      state[j] = seed | 1;
+    }
+
+    for( unsigned int at=0; at < size; at += LOOPER_EXPORT_BATCH){
+      if( job.shouldExit() ) return -1;
+      unsigned int n = jmin( size - at, (unsigned int)LOOPER_EXPORT_BATCH );
+      for( unsigned int c=0; c < channels; c++){
+        if( kept == bits ) k.tpdf( dither, state, n );
+        k.toInt( planes[c], data + c * size + at, kept == bits ? dither.getData() : 0, scale, 32 - kept, n );
+      }
+      if( !writer->write( (const int**)planes.getData(), n ) ) return -1;
+    }
+  }
+  if( !temp.overwriteTargetFileWithTemporary() ) return -1;
+  return job.file.getSize();
+}
+
+LooperExport::Job::Job( LooperExport& owner_, int loop_, const File& file_, AudioFormat *format_, int bitsPerSample_ ) :
+    ThreadPoolJob("LooperExport"), owner(owner_), loop(loop_), file(file_), format(format_), bitsPerSample(bitsPerSample_) {}
+
+LooperExport::Job::~Job(){
+  const ScopedLock sl( owner.lock );
+  if( --owner.remaining > 0 ) return;
+  owner.report.seconds = ( Time::getMillisecondCounter() - owner.started ) / 1000.0;
+  owner.ready = true;
+}
+
+ThreadPoolJob::JobStatus LooperExport::Job::runJob(){
+  HeapBlock<float> data;
+  unsigned int channels, size;
+  int64 bytes = -1;
+  if( owner.looper->snapshot( loop, data, channels, size, LOOPER_EXPORT_WAIT ) && !shouldExit() )
+    bytes = owner.write( *this, data, channels, size );
+
+  const ScopedLock sl( owner.lock );
+  LooperExportReport& r = owner.report;
+  if( bytes < 0 ){
+    r.failed++;
+    return jobHasFinished;
+  }
+  r.files++;
+  r.frames += size;
+  r.bytes += bytes;
+  r.audioSeconds += (double)size / owner.looper->sampleRate;
+  return jobHasFinished;
+}
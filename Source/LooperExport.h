@@ -0,0 +1,81 @@
+
+#ifndef _LOOPEREXPORT_H_
+#define _LOOPEREXPORT_H_
+
+#include "Looper.h"
+
+//frames converted and handed to the writer at a time, and ms a loop that cannot
+//be held still, while it is recorded, is waited for before its file fails
+#define LOOPER_EXPORT_BATCH 8192
+#define LOOPER_EXPORT_WAIT 3000
+//quality of the lossy formats, an index into their getQualityOptions. 192 kbps ogg vorbis
+#define LOOPER_EXPORT_QUALITY 6
+
+// what the last export did
+struct LooperExportReport {
+  int files, failed;
+  int64 frames; //across every file
+  int64 bytes; //written
+  double seconds; //from queuing to the last file closed
+  double audioSeconds; //of all the loops together
+};
+
+// writes every loop with samples to a file of its own, side by side on a pool
+// of threads, through the writers AudioFormatManager::registerBasicFormats
+// provides. samples are converted to the writer's bit depth with triangular
+// dither from LoopKernels::tpdf through LoopKernels::toInt, lossy formats get
+// the full 24 bits.
+//
+// each loop is copied out first, to a snapshot that is all of it at one
+// moment, from an undo layer the audio thread holds still (Looper::snapshot).
+// a loop being overdubbed is copied from the layer below the pass under way
+class LooperExport {
+public:
+
+  LooperExport( Looper *looper, int numThreads = SystemStats::getNumCpus() );
+  ~LooperExport();
+
+  //every loop with samples, each to target's name with the loop's number added
+  //in target's folder, in the format target's extension picks, wav if none
+  //does. bitsPerSample, 16 or 24, for the lossless formats. how many loops were
+  //queued, 0 while an export is still under way. gui thread
+  int exportAll( const File& target, int bitsPerSample = 24 );
+  //for a file chooser, the formats that write
+  String getWildcard();
+  bool isBusy() const { return pool.getNumJobs() > 0; }
+  //the last export's report, once, after it has finished. false otherwise
+  bool takeReport( LooperExportReport& report );
+
+private:
+  //one loop to one file
+  class Job : public ThreadPoolJob {
+  public:
+    Job( LooperExport& owner, int loop, const File& file, AudioFormat *format, int bitsPerSample );
+    //counts the export down whether or not the job ever ran
+    ~Job();
+    JobStatus runJob();
+
+    LooperExport& owner;
+    int loop;
+    File file;
+    AudioFormat *format;
+    int bitsPerSample;
+  };
+
+  Looper *looper;
+  AudioFormatManager formats;
+  CriticalSection lock;
+  LooperExportReport report; //of the export under way or the last one
+  int remaining; //jobs of it not gone yet
+  bool ready; //report not taken yet
+  uint32 started;
+  ThreadPool pool; //last, its jobs are stopped before anything they use goes
+
+  //the file's size in bytes, -1 if it could not be written
+  int64 write( Job& job, const float *data, unsigned int channels, unsigned int size );
+
+  LooperExport( const LooperExport& );
+  LooperExport& operator=( const LooperExport& );
+};
+
+#endif
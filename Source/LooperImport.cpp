@@ -0,0 +1,276 @@
+#include <string.h>
+
+#include "LooperImport.h"
+#include "LoopKernels.h"
+
+LooperImport::LooperImport( Looper *looper_, int numThreads ) : looper(looper_), reading(0),
+    pool( jmax( 1, numThreads ) ) {
+  formats.registerBasicFormats();
+  pool.setThreadPriorities(3);
+}
+
+LooperImport::~LooperImport(){
+  pool.removeAllJobs( true, 4000 );
+}
+
+bool LooperImport::import( int loop, const File& file ){
+  if( loop < 0 || loop >= (int)looper->loops.size() ) return false;
+  AudioFormatReader *reader = formats.createReaderFor( file );
+  if( !reader ) return false;
+  return start( loop, reader, file.getFileName() );
+}
+
+int LooperImport::importAll( int first, const Array<File>& files ){
+  int numLoops = (int)looper->loops.size();
+  if( first < 0 || first >= numLoops ) return 0;
+
+  StringArray paths;
+  for( int i=0; i < files.size(); i++){
+    if( !files[i].isDirectory() ){
+      paths.add( files[i].getFullPathName() );
+      continue;
+    }
+    Array<File> found;
+    files[i].findChildFiles( found, File::findFiles, true );
+    for( int j=0; j < found.size(); j++)
+      if( canImport( found[j] ) ) paths.add( found[j].getFullPathName() );
+  }
+  paths.sort( true );
+
+  int queued = 0, next = first;
+  for( int i=0; i < paths.size(); i++){
+    File file( paths[i] );
+    AudioFormatReader *reader = formats.createReaderFor( file );
+    if( !reader ) continue;
+
+    int loop = -1;
+    for( int j=0; j < numLoops && loop < 0; j++){
+      int candidate = (next + j) % numLoops;
+      LooperImportStatus status;
+      if( queued == 0 && candidate == first ) loop = first;
+      else if( looper->meter(candidate).numSamples == 0 && !(getStatus( candidate, status ) && status.busy) )
+        loop = candidate;
+    }
+    if( loop < 0 ){
+      delete reader;
+      break;
+    }
+    if( start( loop, reader, file.getFileName() ) ) queued++;
+    next = (loop + 1) % numLoops;
+  }
+  return queued;
+}
+
+bool LooperImport::canImport( const File& file ) const {
+  return file.isDirectory() || formats.findFormatForFileExtension( file.getFileExtension() ) != 0;
+}
+
+bool LooperImport::getStatus( int loop, LooperImportStatus& status ){
+  const ScopedLock sl( lock );
+  if( loop < 0 || loop >= (int)entries.size() || entries[loop].status.name.isEmpty() ) return false;
+  status = entries[loop].status;
+  return true;
+}
+
+bool LooperImport::start( int loop, AudioFormatReader *reader, const String& name ){
+  Job *job = new Job( *this, loop, reader );
+  {
+    const ScopedLock sl( lock );
+    if( loop >= (int)entries.size() ){
+      Entry none;
+      none.job = 0;
+      entries.resize( loop + 1, none );
+    }
+    Entry& e = entries[loop];
+    //queued it is dropped by the pool, decoding it stops at the next batch
+    if( e.job ) e.job->signalJobShouldExit();
+    e.job = job;
+    e.status.name = name;
+    e.status.progress = e.status.peak = 0.f;
+    e.status.busy = true;
+  }
+  pool.addJob( job, true );
+  return true;
+}
+
+void LooperImport::report( Job& job, float progress, float peak ){
+  const ScopedLock sl( lock );
+  Entry& e = entries[job.loop];
+  if( e.job != &job ) return;
+  e.status.progress = progress;
+  e.status.peak = peak;
+}
+
+void LooperImport::beginRead(){
+  for(;;){
+    {
+      const ScopedLock sl( readLock );
+      if( reading < LOOPER_IMPORT_READS ){
+        reading++;
+        return;
+      }
+    }
+    readDone.wait( LOOPER_IMPORT_POLL );
+  }
+}
+
+void LooperImport::endRead(){
+  {
+    const ScopedLock sl( readLock );
+    reading--;
+  }
+  readDone.signal();
+}
+
+LooperImport::Job::Job( LooperImport& owner_, int loop_, AudioFormatReader *reader_ ) : ThreadPoolJob("LooperImport"),
+    owner(owner_), loop(loop_), reader(reader_) {}
+
+LooperImport::Job::~Job(){
+  const ScopedLock sl( owner.lock );
+  Entry& e = owner.entries[loop];
+  if( e.job != this ) return;
+  e.job = 0;
+  e.status.busy = false;
+}
+
+ThreadPoolJob::JobStatus LooperImport::Job::runJob(){
+  owner.decode( *this );
+  return jobHasFinished;
+}
+
+//an old job and the new one into the same loop may overlap, they take turns at its meter
+LoopMeter LooperImport::state( int loop ){
+  const ScopedLock sl( lock );
+  return looper->importMeter( loop );
+}
+
+bool LooperImport::publish( int loop, Stream& s, bool last ){
+  if( s.handed > 0 ){
+    LoopMeter m = state( loop );
+    if( m.layout == s.layout ) return true; //the load is still queued
+    if( m.stream != s.id ) return false;
+    if( m.numSamples != s.handed ) return true; //and so is the last extend
+  }
+  unsigned int have = s.done - s.handed;
+  unsigned int n = last ? (unsigned int)s.image->chunks[0].size() : have >> LOOP_CHUNK_BITS;
+  if( n == 0 ) return true;
+
+  LoopImage *piece = new LoopImage( &looper->pool, s.image->numChannels, s.image->sampleRate );
+  piece->stream = s.id;
+  piece->numSamples = last ? have : n << LOOP_CHUNK_BITS;
+  for( unsigned int c=0; c < s.image->numChannels; c++){
+    std::vector<float*>& from = s.image->chunks[c];
+    piece->chunks[c].assign( from.begin(), from.begin() + n );
+    from.erase( from.begin(), from.begin() + n );
+  }
+  s.image->numSamples = have - piece->numSamples;
+  if( s.handed == 0 ) looper->load( loop, piece );
+  else looper->extend( loop, piece );
+  s.handed += have - s.image->numSamples;
+  return true;
+}
+
+//the file is read into a window of mixed down frames with the interpolator's
+//halo either side, past its end reads as silence. outputs go straight into
+//the image's chunks, a chunk's worth or what the window covers at a time
+void LooperImport::decode( Job& job ){
+  const LoopKernels& k = getLoopKernels();
+  AudioFormatReader *reader = job.reader;
+  LoopMeter m = state( job.loop );
+  unsigned int channels = jlimit( 1u, (unsigned int)LOOP_MAX_CHANNELS, m.channels );
+  unsigned int fileChannels = reader->numChannels;
+  unsigned int rate = looper->sampleRate;
+  if( fileChannels == 0 || reader->sampleRate <= 0.0 || reader->lengthInSamples <= 0 || rate == 0 ) return;
+
+  uint64 step = (uint64)( reader->sampleRate / rate * 4294967296.0 + 0.5 );
+  bool exact = step == ((uint64)1 << 32);
+  uint64 total = exact ? (uint64)reader->lengthInSamples : (uint64)( reader->lengthInSamples * (double)rate / reader->sampleRate );
+  total = jmin( total, (uint64)0xffffffffu );
+  unsigned int margin = exact ? 0 : LOOP_INTERP_HALO;
+
+  HeapBlock<int> raw( fileChannels * LOOPER_IMPORT_BATCH );
+  HeapBlock<int*> rawChannels( fileChannels );
+  for( unsigned int j=0; j < fileChannels; j++) rawChannels[j] = raw + j * LOOPER_IMPORT_BATCH;
+  const unsigned int size = LOOPER_IMPORT_BATCH + 2 * LOOP_INTERP_HALO + 2;
+  HeapBlock<float> window;
+  window.calloc( channels * size );
+  int64 start = -(int64)margin, readPos = 0;
+  unsigned int length = margin;
+
+  Stream s;
+  s.id = ++streams;
+  s.layout = m.layout;
+  s.image = new LoopImage( &looper->pool, channels, rate );
+  s.handed = s.done = 0;
+  uint64 pos = 0; //in file frames, 32.32
+  float peak = 0.f;
+
+  bool going = true;
+  while( going && s.done < total ){
+    if( job.shouldExit() ){ going = false; break; }
+    int64 end = start + length;
+    uint64 limit = end > (int64)margin ? (uint64)(end - margin) << 32 : 0;
+    unsigned int n = 0;
+    if( pos < limit ) n = (unsigned int)jmin( (limit - pos + step - 1) / step, total - s.done );
+
+    if( n > 0 ){
+      unsigned int at = s.done - s.handed;
+      n = jmin( n, (unsigned int)LOOP_CHUNK_SIZE - (at & LOOP_CHUNK_MASK) );
+      //the import ends where it would eat into the recording reserve. short of
+      //that the refill thread may just be behind
+      if( (at & LOOP_CHUNK_MASK) == 0 && looper->spareChunks() < channels ){ total = s.done; break; }
+      if( !s.image->resize( at + n ) ){
+        Thread::sleep( LOOPER_IMPORT_POLL );
+        continue;
+      }
+      uint64 phase = pos - (uint64)( start * (int64)4294967296LL );
+      for( unsigned int c=0; c < channels; c++){
+        const float *src = window + c * size;
+        if( exact ) k.copyGain( s.image->at(c,at), src + (phase >> 32), 1.f, n );
+        else k.interpSinc( s.image->at(c,at), src, phase, step, n );
+        k.meter( s.image->at(c,at), n, &peak );
+      }
+      pos += n * step;
+      s.done += n;
+      report( job, (float)s.done / total, peak );
+      going = publish( job.loop, s, false );
+    }else{
+      //slide down to what the interpolator still needs and read the next batch in behind
+      int64 keep = jmin( (int64)(pos >> 32) - (int64)margin, end );
+      unsigned int drop = (unsigned int)(keep - start);
+      for( unsigned int c=0; c < channels; c++)
+        memmove( window + c * size, window + c * size + drop, (length - drop) * sizeof(float) );
+      start = keep;
+      length -= drop;
+
+      unsigned int m = jmin( (unsigned int)LOOPER_IMPORT_BATCH, size - length );
+      beginRead();
+      bool read = reader->read( rawChannels, fileChannels, readPos, m, false );
+      endRead();
+      if( !read ){ total = s.done; break; }
+      float **in = (float**)(int**)rawChannels;
+      if( !reader->usesFloatingPointData )
+        for( unsigned int j=0; j < fileChannels; j++) k.fromInt( in[j], rawChannels[j], 1.f / 2147483648.f, m );
+      //more file channels than loop ones are averaged round robin, fewer repeat the last
+      for( unsigned int c=0; c < channels; c++){
+        float *dst = window + c * size + length;
+        if( fileChannels <= channels ){
+          k.copyGain( dst, in[ jmin( c, fileChannels-1 ) ], 1.f, m );
+          continue;
+        }
+        float g = 1.f / ((fileChannels - c + channels - 1) / channels);
+        k.copyGain( dst, in[c], g, m );
+        for( unsigned int j = c + channels; j < fileChannels; j += channels) k.mix( dst, in[j], g, m );
+      }
+      length += m;
+      readPos += m;
+    }
+  }
+
+  //the rest once the looper has taken the piece before
+  while( going && s.handed < s.done && !job.shouldExit() ){
+    going = publish( job.loop, s, true );
+    if( going && s.handed < s.done ) Thread::sleep( LOOPER_IMPORT_POLL );
+  }
+  delete s.image;
+}
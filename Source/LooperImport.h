@@ -0,0 +1,113 @@
+
+#ifndef _LOOPERIMPORT_H_
+#define _LOOPERIMPORT_H_
+
+#include <vector>
+
+#include "Looper.h"
+
+//file frames decoded per read, and ms between looks at whether the looper
+//has taken the last piece
+#define LOOPER_IMPORT_BATCH 8192
+#define LOOPER_IMPORT_POLL 5
+//files read from disk at once however many are decoding, the others wait their turn
+#define LOOPER_IMPORT_READS 2
+
+// how far the last import into a loop has got
+struct LooperImportStatus {
+  String name; //of the file
+  float progress; //0 to 1
+  float peak; //of what has been decoded
+  bool busy; //queued or decoding
+};
+
+// reads audio files into loops on a pool of threads, through whatever
+// formats AudioFormatManager::registerBasicFormats provides. files are mixed
+// down (or spread) to the loop's channel count, converted to float and
+// resampled to the looper's rate with the sinc interpolator, a batch at a time
+// through LoopKernels, straight into pool chunks.
+//
+// the loop is loaded as soon as its first chunk is decoded and extended by
+// every chunk since whenever the last piece has been taken, so it can play
+// while the rest comes in, up to what has arrived. one piece per import is in
+// flight at a time, the command queue never fills up however fast decoding
+// is. an import stops once the loop is cleared, recorded or loaded over, and
+// where it would take pool memory kept for recording (LOOPER_POOL_RESERVE_MB).
+//
+// imports into different loops decode side by side, one per thread. only
+// LOOPER_IMPORT_READS of them read the disk at a time, decoding and
+// resampling what they have read overlaps with the others' reads
+class LooperImport {
+public:
+
+  LooperImport( Looper *looper, int numThreads = SystemStats::getNumCpus() );
+  ~LooperImport();
+
+  //queue file for loop i, an earlier import into i is stopped. false if no
+  //format reads it. gui thread
+  bool import( int loop, const File& file );
+  //files, and the audio files anywhere in folders, in name order: the first into
+  //loop first, the rest into the empty loops after it, wrapping round. how many
+  //were queued. gui thread
+  int importAll( int first, const Array<File>& files );
+  //a folder, or a file with an extension some format reads
+  bool canImport( const File& file ) const;
+  //for a file chooser
+  String getWildcard() const { return formats.getWildcardForAllFormats(); }
+  //imports queued or under way
+  bool isBusy() const { return pool.getNumJobs() > 0; }
+  //false if nothing has been imported into loop
+  bool getStatus( int loop, LooperImportStatus& status );
+
+private:
+  //one file into one loop
+  class Job : public ThreadPoolJob {
+  public:
+    Job( LooperImport& owner, int loop, AudioFormatReader *reader );
+    //the loop's status stops being busy here, whether or not the job ever ran
+    ~Job();
+    JobStatus runJob();
+
+    LooperImport& owner;
+    int loop;
+    ScopedPointer<AudioFormatReader> reader;
+  };
+  //the decoding side of an import
+  struct Stream {
+    uint32 id;
+    uint32 layout; //the loop's before the load, it moves once that is applied
+    LoopImage *image; //decoded but not handed over, from loop sample handed on
+    unsigned int handed, done; //samples handed over, decoded
+  };
+  struct Entry {
+    Job *job; //the latest import into the loop, 0 once it is gone
+    LooperImportStatus status;
+  };
+
+  Looper *looper;
+  AudioFormatManager formats;
+  CriticalSection lock;
+  std::vector<Entry> entries; //per loop, as far as any has been imported into
+  Atomic<uint32> streams; //last id handed out
+  CriticalSection readLock;
+  int reading;
+  WaitableEvent readDone;
+  ThreadPool pool; //last, its jobs are stopped before anything they use goes
+
+  bool start( int loop, AudioFormatReader *reader, const String& name );
+  //loop as the audio thread last published it, from any job
+  LoopMeter state( int loop );
+  void decode( Job& job );
+  //hand over the whole chunks decoded, all of them when last, if the looper has
+  //taken the piece before. false once the loop holds something else
+  bool publish( int loop, Stream& s, bool last );
+  void report( Job& job, float progress, float peak );
+  //wait for one of the LOOPER_IMPORT_READS turns at the disk, and give it back
+  void beginRead();
+  void endRead();
+
+  LooperImport( const LooperImport& );
+  LooperImport& operator=( const LooperImport& );
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+#include "LooperSession.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/mman.h>
+#endif
+
+LooperSession::LooperSession( Looper *looper_, int intervalSeconds ) : Thread("LooperSession"), looper(looper_),
+    base(0), baseSize(0), generation(0), liveBytes(0), slot(0), interval(intervalSeconds) {
+  startThread(2);
+}
+
+LooperSession::~LooperSession(){
+  stopThread(-1);
+  checkpoint();
+}
+
+void LooperSession::setInterval( int seconds ){
+  interval = seconds;
+  notify();
+}
+
+void LooperSession::run(){
+  while( !threadShouldExit() ){
+    wait( interval > 0 ? interval * 1000 : -1 );
+    if( !threadShouldExit() && interval > 0 ) checkpoint();
+  }
+}
+
+uint32 LooperSession::checksum( const void *data, size_t size, uint32 h ){
+  const unsigned char *p = (const unsigned char*)data;
+  for( size_t i=0; i < size; i++){
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+const LooperSessionSuper* LooperSession::current( const char *data, size_t size ){
+  const LooperSessionSuper *best = 0;
+  if( size < 2 * LOOPER_SESSION_BLOCK ) return 0;
+  for( int slot=0; slot < 2; slot++){
+    const LooperSessionSuper *s = (const LooperSessionSuper*)(data + slot * LOOPER_SESSION_BLOCK);
+    if( memcmp( s->magic, LOOPER_SESSION_MAGIC, sizeof(s->magic) ) || s->version != LOOPER_SESSION_VERSION ) continue;
+    if( s->sum != checksum( s, offsetof( LooperSessionSuper, sum ) ) ) continue;
+    if( s->tableOffset < 2 * LOOPER_SESSION_BLOCK || s->tableOffset > size || s->tableSize > size - s->tableOffset ) continue;
+    if( s->tableSum != checksum( data + s->tableOffset, (size_t)s->tableSize ) ) continue;
+    if( !best || s->generation > best->generation ) best = s;
+  }
+  return best;
+}
+
+bool LooperSession::hasAudio( const File& file ){
+  MemoryMappedFile map( file, MemoryMappedFile::readOnly );
+  const char *data = (const char*)map.getData();
+  const LooperSessionSuper *s = data ? current( data, map.getSize() ) : 0;
+  if( !s ) return false;
+  const char *t = data + s->tableOffset, *end = t + s->tableSize;
+  for( unsigned int i=0; i < s->numLoops; i++){
+    if( end - t < (ptrdiff_t)sizeof(LooperSessionLoop) ) return false;
+    const LooperSessionLoop *r = (const LooperSessionLoop*)t;
+    if( r->numSamples > 0 ) return true;
+    t += sizeof(LooperSessionLoop) + (size_t)r->channels * r->numChunks * sizeof(uint64);
+  }
+  return false;
+}
+
+//last written first
+struct NewestFirst {
+  static int compareElements( const File& a, const File& b ){
+    Time ta = a.getLastModificationTime(), tb = b.getLastModificationTime();
+    return ta > tb ? -1 : ta < tb ? 1 : 0;
+  }
+};
+
+Array<File> LooperSession::autosaves( const File& folder ){
+  Array<File> found, kept;
+  folder.findChildFiles( found, File::findFiles, false, "*.loops" );
+  for( int i=0; i < found.size(); i++)
+    if( hasAudio( found[i] ) ) kept.add( found[i] );
+  NewestFirst order;
+  kept.sort( order );
+  return kept;
+}
+
+File LooperSession::nextAutosave( const File& folder, int keep ){
+  Array<File> found;
+  folder.findChildFiles( found, File::findFiles, false, "*.loops" );
+  Array<File> kept = autosaves( folder );
+  for( int i=0; i < found.size(); i++)
+    if( kept.indexOf( found[i] ) < 0 || kept.indexOf( found[i] ) >= keep - 1 ) found[i].deleteFile();
+  folder.createDirectory();
+  return folder.getChildFile( "autosave-" + Time::getCurrentTime().formatted( "%Y%m%d-%H%M%S" ) + ".loops" )
+               .getNonexistentSibling();
+}
+
+//everything but the samples, as the audio thread last published it
+static void describe( const LoopMeter& m, LooperSessionLoop& r ){
+  r.channels = jlimit( 1u, (unsigned int)LOOP_MAX_CHANNELS, m.channels );
+  r.numSamples = r.numChunks = 0;
+  r.sampleRate = m.sampleRate;
+  r.rMin = m.rMin;
+  r.rMax = m.rMax;
+  r.flags = (m.flags & LoopMeter::Playing ? LooperSessionLoop::Playing : 0)
+          | (m.flags & LoopMeter::Reversing ? LooperSessionLoop::Reversing : 0)
+          | (m.flags & LoopMeter::RecordOutput ? LooperSessionLoop::RecordOutput : 0);
+  r.interpolation = m.interpolation;
+  r.gain = m.gain;
+  r.pan = m.pan;
+  r.decay = m.decay;
+  r.speed = m.speed;
+  r.stretch = m.stretch;
+  r.fitSeconds = m.sampleRate ? (float)m.fitLength / m.sampleRate : 0.f;
+}
+
+//pad out to the next chunk boundary
+static bool align( FileOutputStream& out ){
+  char zeros[LOOPER_SESSION_BLOCK];
+  zeromem( zeros, sizeof(zeros) );
+  int64 left;
+  while( (left = (LOOP_CHUNK_BYTES - out.getPosition() % LOOP_CHUNK_BYTES) % LOOP_CHUNK_BYTES) > 0 )
+    if( !out.write( zeros, (size_t)jmin( left, (int64)sizeof(zeros) ) ) ) return false;
+  return true;
+}
+
+LooperSession::Writer::Writer( LooperSession& session_, FileOutputStream& out_, const Saved& saved_,
+                              const std::vector<uint32>& versions_, bool all_, bool full_ )
+  : session(session_), out(out_), saved(saved_), versions(versions_), all(all_), full(full_),
+    failed(false), channels(0), size(0) {}
+
+//a chunk counts as on disk if it is mapped from the file, or its version is the
+//one saved. mapped chunks are never written, nor are the held layer's meanwhile
+bool LooperSession::Writer::read( const LoopLayer& layer, unsigned int channels_, unsigned int size_ ){
+  channels = channels_;
+  size = size_;
+  unsigned int n = (size + LOOP_CHUNK_MASK) >> LOOP_CHUNK_BITS, had = saved.versions.size();
+  bool fresh = all || saved.channels != channels;
+  offsets.assign( channels * n, 0 );
+
+  for( unsigned int k=0; k < n; k++){
+    const char *p[LOOP_MAX_CHANNELS];
+    bool mapped = !full && session.base != 0;
+    for( unsigned int c=0; c < channels; c++){
+      p[c] = (const char*)layer.chunks[c][k];
+      mapped = mapped && p[c] >= session.base && p[c] < session.base + session.baseSize;
+    }
+
+    if( mapped ){
+      for( unsigned int c=0; c < channels; c++) offsets[ c*n + k ] = p[c] - session.base;
+    }else if( !fresh && k < had && k < versions.size() && saved.versions[k] == versions[k] ){
+      for( unsigned int c=0; c < channels; c++) offsets[ c*n + k ] = saved.offsets[ c*had + k ];
+    }else{
+      failed = !align( out );
+      for( unsigned int c=0; c < channels && !failed; c++){
+        offsets[ c*n + k ] = out.getPosition();
+        failed = !out.write( p[c], LOOP_CHUNK_BYTES );
+      }
+      if( failed ) return false;
+    }
+  }
+  return true;
+}
+
+//the record comes from the session meter, the samples from a layer held still.
+//chunk versions are taken before the hold, so one written in between is only
+//ever saved again
+bool LooperSession::store( unsigned int i, FileOutputStream& out, bool full ){
+  LoopBuffer& b = looper->loops[i]->b;
+  Saved& s = saved[i];
+  const LoopMeter& m = looper->sessionMeter( i );
+  LooperSessionLoop r;
+  describe( m, r );
+
+  uint32 layout = b.layout.get();
+  std::vector<uint32> versions( b.versions ? b.maxChunks : 0 );
+  for( unsigned int k=0; k < versions.size(); k++) versions[k] = b.versions[k].get();
+  Writer w( *this, out, s, versions, full || !s.valid || s.layout != layout, full );
+
+  bool held = m.numSamples == 0;
+  if( !held && !(m.flags & LoopMeter::Recording) )
+    held = looper->readHeld( i, w, LOOPER_SESSION_WAIT ) && b.layout.get() == layout;
+  if( !held && ( s.valid || w.failed ) ) return false;
+  //empty, or being recorded with no autosave of it yet
+  if( !held || m.numSamples == 0 ){
+    w.channels = r.channels;
+    w.size = 0;
+    w.offsets.clear();
+  }
+
+  r.channels = w.channels;
+  r.numSamples = w.size;
+  r.numChunks = (r.numSamples + LOOP_CHUNK_MASK) >> LOOP_CHUNK_BITS;
+  r.rMax = jmin( r.rMax, r.numSamples );
+  r.rMin = jmin( r.rMin, r.rMax );
+  versions.resize( r.numChunks );
+
+  s.valid = true;
+  s.layout = layout;
+  s.channels = r.channels;
+  s.versions.swap( versions );
+  s.offsets.swap( w.offsets );
+  s.record.setSize( sizeof(r) + s.offsets.size() * sizeof(uint64) );
+  s.record.copyFrom( &r, 0, sizeof(r) );
+  if( !s.offsets.empty() ) s.record.copyFrom( &s.offsets[0], sizeof(r), s.offsets.size() * sizeof(uint64) );
+  return true;
+}
+
+//a loop that cannot be held goes in as of the last autosave
+bool LooperSession::write( const File& target, bool full ){
+  unsigned int numLoops = looper->loops.size();
+  Saved none;
+  none.valid = false;
+  none.layout = 0;
+  none.channels = 0;
+  if( saved.size() < numLoops ) saved.resize( numLoops, none );
+  if( full ) for( unsigned int i=0; i < saved.size(); i++) saved[i].valid = false;
+
+  ScopedPointer<TemporaryFile> temp( full ? new TemporaryFile( target ) : 0 );
+  MemoryBlock t;
+  uint64 live = 2 * LOOPER_SESSION_BLOCK;
+  bool ok = false;
+  int next = full ? 0 : 1 - slot;
+  LooperSessionSuper s;
+  {
+    FileOutputStream out( full ? temp->getFile() : target );
+    if( out.failedToOpen() ) return false;
+    if( full ){
+      //both slots empty until the rest is down
+      char zeros[2 * LOOPER_SESSION_BLOCK];
+      zeromem( zeros, sizeof(zeros) );
+      if( !out.write( zeros, sizeof(zeros) ) || !align( out ) ) return false;
+    }
+
+    unsigned int i = 0;
+    for( ; i < numLoops; i++){
+      if( !store( i, out, full ) && !saved[i].valid ) break;
+      t.append( saved[i].record.getData(), saved[i].record.getSize() );
+      live += saved[i].offsets.size() * LOOP_CHUNK_BYTES;
+    }
+    //nothing to add, nothing was appended either
+    if( !full && i == numLoops && t == table ) return true;
+
+    zeromem( &s, sizeof(s) );
+    memcpy( s.magic, LOOPER_SESSION_MAGIC, sizeof(s.magic) );
+    s.version = LOOPER_SESSION_VERSION;
+    s.numLoops = numLoops;
+    s.generation = full ? 1 : generation + 1;
+    s.tableOffset = out.getPosition();
+    s.tableSize = t.getSize();
+    s.tableSum = checksum( t.getData(), t.getSize() );
+    s.sum = checksum( &s, offsetof( LooperSessionSuper, sum ) );
+
+    //everything the slot points at is on disk before the slot is
+    if( i == numLoops && out.write( t.getData(), t.getSize() ) ){
+      out.flush();
+      if( out.getStatus().wasOk() && out.setPosition( next * LOOPER_SESSION_BLOCK ) && out.write( &s, sizeof(s) ) ){
+        out.flush();
+        ok = out.getStatus().wasOk();
+      }
+    }
+  }
+  if( ok && full ){
+    ok = temp->overwriteTargetFileWithTemporary();
+    if( ok ){
+      file = target;
+      base = 0;
+      baseSize = 0;
+    }
+  }
+  if( !ok ){
+    //chunks stored into a file that did not make it
+    if( full ) for( unsigned int i=0; i < saved.size(); i++) saved[i].valid = false;
+    return false;
+  }
+  generation = s.generation;
+  slot = next;
+  table = t;
+  liveBytes = live + t.getSize();
+  return true;
+}
+
+bool LooperSession::save( const File& to ){
+  const ScopedLock sl( lock );
+  return write( to, true );
+}
+
+bool LooperSession::checkpoint(){
+  const ScopedLock sl( lock );
+  if( file == File::nonexistent ) return false;
+  for( unsigned int i=0; i < pending.size() && i < looper->loops.size(); i++)
+    if( looper->loops[i]->b.layout.get() == pending[i] ) return false;
+  pending.clear();
+  int64 size = file.getSize();
+  bool full = !file.existsAsFile() || size < 2 * LOOPER_SESSION_BLOCK || (uint64)size > LOOPER_SESSION_GROWTH * liveBytes;
+  return write( file, full );
+}
+
+bool LooperSession::load( const File& from ){
+  const ScopedLock sl( lock );
+  ScopedPointer<MemoryMappedFile> map( new MemoryMappedFile( from, MemoryMappedFile::readOnly ) );
+  const char *data = (const char*)map->getData();
+  size_t size = map->getSize();
+  const LooperSessionSuper *s = data ? current( data, size ) : 0;
+  if( !s ) return false;
+
+  //check every record and offset before any loop is touched
+  std::vector<const LooperSessionLoop*> records;
+  const char *t = data + s->tableOffset, *end = t + s->tableSize;
+  for( unsigned int i=0; i < s->numLoops; i++){
+    if( end - t < (ptrdiff_t)sizeof(LooperSessionLoop) ) return false;
+    const LooperSessionLoop *r = (const LooperSessionLoop*)t;
+    t += sizeof(LooperSessionLoop);
+    if( r->channels < 1 || r->channels > LOOP_MAX_CHANNELS ) return false;
+    if( r->numChunks != (r->numSamples + LOOP_CHUNK_MASK) >> LOOP_CHUNK_BITS ) return false;
+    size_t n = (size_t)r->channels * r->numChunks;
+    if( (size_t)(end - t) / sizeof(uint64) < n ) return false;
+    const uint64 *offsets = (const uint64*)t;
+    for( size_t k=0; k < n; k++)
+      if( offsets[k] % LOOP_CHUNK_BYTES || offsets[k] > size || size - offsets[k] < LOOP_CHUNK_BYTES ) return false;
+    t += n * sizeof(uint64);
+    records.push_back( r );
+  }
+
+#if ! JUCE_WINDOWS
+  //read ahead of the audio thread rather than as it gets there
+  madvise( (void*)data, size, MADV_WILLNEED );
+#endif
+
+  pending.resize( looper->loops.size() );
+  for( unsigned int i=0; i < looper->loops.size(); i++){
+    pending[i] = looper->loops[i]->b.layout.get();
+    if( i >= records.size() ){
+      looper->stop( i );
+      looper->clear( i );
+      continue;
+    }
+    const LooperSessionLoop *r = records[i];
+    const uint64 *offsets = (const uint64*)(r + 1);
+    LoopImage *image = new LoopImage( &looper->pool, r->channels, r->sampleRate );
+    for( unsigned int c=0; c < r->channels; c++){
+      image->chunks[c].resize( r->numChunks );
+      for( unsigned int k=0; k < r->numChunks; k++)
+        image->chunks[c][k] = (float*)(data + offsets[ c * r->numChunks + k ]);
+    }
+    image->numSamples = r->numSamples;
+    image->rMin = r->rMin;
+    image->rMax = r->rMax;
+    looper->load( i, image );
+
+    looper->setGain( i, r->gain );
+    looper->setPan( i, r->pan );
+    looper->setDecay( i, r->decay );
+    looper->setSpeed( i, r->speed );
+    looper->setStretch( i, r->stretch );
+    looper->fitLength( i, r->fitSeconds );
+    looper->setInterpolation( i, r->interpolation );
+    looper->setRecordOutput( i, (r->flags & LooperSessionLoop::RecordOutput) != 0 );
+    if( r->flags & LooperSessionLoop::Reversing ) looper->reverse( i );
+    if( r->flags & LooperSessionLoop::Playing ) looper->play( i );
+    else looper->stop( i );
+  }
+
+  //autosaves append to the file the loops now map
+  file = from;
+  base = data;
+  baseSize = size;
+  saved.clear();
+  table.setSize( 0 );
+  generation = s->generation;
+  slot = (const char*)s == data ? 0 : 1;
+  liveBytes = size;
+  mappings.add( map.release() );
+  return true;
+}
@@ -0,0 +1,146 @@
+
+#ifndef _LOOPERSESSION_H_
+#define _LOOPERSESSION_H_
+
+#include <vector>
+
+#include "Looper.h"
+
+#define LOOPER_SESSION_MAGIC "LOOPSES1"
+#define LOOPER_SESSION_VERSION 1
+//size of each of the two superblock slots at the start of the file
+#define LOOPER_SESSION_BLOCK 4096
+//seconds between autosaves, and how many times what the session holds the
+//file may grow to before an autosave writes it over whole
+#define LOOPER_SESSION_INTERVAL 10
+#define LOOPER_SESSION_GROWTH 3
+//autosaves with audio in them kept in an autosave folder, the newest first
+#define LOOPER_SESSION_KEEP 5
+//ms a save waits for the audio thread to hold a loop still
+#define LOOPER_SESSION_WAIT 1000
+
+// session file. sample data is stored as loop chunks, LOOP_CHUNK_BYTES of
+// native floats at multiples of LOOP_CHUNK_BYTES, so a loaded loop's chunk
+// tables point straight into the mapped file:
+//   two superblock slots  the valid one with the higher generation is current
+//   chunks                anywhere after the slots, in any order
+//   table                 LooperSessionLoop per loop, each followed by the file
+//                         offsets of its chunks, numChunks per channel
+// a slot is only written once everything it points at is on disk, and never
+// the one in use, so a torn write leaves the session as it was
+struct LooperSessionSuper {
+  char magic[8];
+  uint32 version;
+  uint32 numLoops;
+  uint64 generation;
+  uint64 tableOffset, tableSize;
+  uint32 tableSum; //fnv-1a of the table
+  uint32 sum; //of everything above
+};
+
+struct LooperSessionLoop {
+  enum Flags { Playing = 1, Reversing = 2, RecordOutput = 4 };
+
+  uint32 channels, numSamples, numChunks, sampleRate;
+  uint32 rMin, rMax, flags, interpolation;
+  float gain, pan, decay, speed;
+  float stretch, fitSeconds;
+};
+
+// saves and loads every loop of a looper with its playback state. loading
+// maps the file and hands the loops over without reading their samples, they
+// come in from disk as the audio thread plays through them. mapped chunks are
+// never written, the first write to one copies it into the pool (see
+// LoopBuffer::writable).
+//
+// the file last saved or loaded is kept up to date from a thread of its own.
+// each autosave appends only the chunks written since the one before (see
+// LoopBuffer::versions) and a new table, syncs, then writes the slot not in
+// use and syncs again. nothing in place is ever overwritten, so mapped loops
+// stay valid and a crash leaves the last complete autosave
+class LooperSession : private Thread {
+public:
+
+  LooperSession( Looper *looper, int intervalSeconds = LOOPER_SESSION_INTERVAL );
+  //autosaves one last time
+  ~LooperSession();
+
+  //write the whole session to file, replacing it once complete. each loop goes in
+  //as it was at one moment, from a layer the audio thread holds still (see
+  //Looper::readHeld), one being recorded as of the last autosave. autosaves go
+  //to file from then on
+  bool save( const File& file );
+  //false if file is not a session, the loops are untouched then. otherwise
+  //autosaves go to file from then on
+  bool load( const File& file );
+
+  //0 stops autosaving
+  void setInterval( int seconds );
+  //bring the file up to date now, false if that failed or loops are still loading
+  bool checkpoint();
+
+  static uint32 checksum( const void *data, size_t size, uint32 h = 2166136261u );
+  //the current superblock of a session in memory, 0 if neither slot is valid
+  static const LooperSessionSuper* current( const char *data, size_t size );
+  //whether file is a session with any loop recorded in it
+  static bool hasAudio( const File& file );
+  //the sessions in folder with audio in them, last written first
+  static Array<File> autosaves( const File& folder );
+  //a file in folder, named for now, to autosave to. sessions there without audio
+  //are deleted first, and the others past the newest keep - 1
+  static File nextAutosave( const File& folder, int keep = LOOPER_SESSION_KEEP );
+
+private:
+  //what the file holds of a loop as of the last autosave
+  struct Saved {
+    bool valid;
+    uint32 layout;
+    unsigned int channels;
+    std::vector<uint32> versions; //per chunk
+    std::vector<uint64> offsets; //numChunks per channel
+    MemoryBlock record; //its table entry
+  };
+
+  Looper *looper;
+  //every session loaded stays mapped, loops and their history may still point
+  //into one long after another has been loaded
+  OwnedArray<MemoryMappedFile> mappings;
+
+  CriticalSection lock;
+  File file;
+  const char *base; //the file's mapping if it was loaded, chunks in it are on disk already
+  size_t baseSize;
+  std::vector<Saved> saved; //per loop
+  std::vector<uint32> pending; //layouts when a load was sent, autosaves wait for them to move
+  MemoryBlock table; //last written
+  uint64 generation, liveBytes;
+  int slot;
+  int interval;
+
+  //appends the chunks of a held layer that are not on disk yet, see store
+  struct Writer : LoopLayerReader {
+    LooperSession& session;
+    FileOutputStream& out;
+    const Saved& saved;
+    const std::vector<uint32>& versions; //read before the hold, no newer than what it holds
+    bool all, full, failed;
+    unsigned int channels, size;
+    std::vector<uint64> offsets; //numChunks per channel
+
+    Writer( LooperSession& session, FileOutputStream& out, const Saved& saved,
+            const std::vector<uint32>& versions, bool all, bool full );
+    bool read( const LoopLayer& layer, unsigned int channels, unsigned int size );
+  };
+
+  void run();
+  //full writes the session to a new file at target, otherwise dirty chunks are appended to file
+  bool write( const File& target, bool full );
+  //append loop i's chunks that need it to out and update saved[i], false if it could
+  //not be held or the file could not be written
+  bool store( unsigned int i, FileOutputStream& out, bool full );
+
+  LooperSession( const LooperSession& );
+  LooperSession& operator=( const LooperSession& );
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "LooperShared.h"
+
+#if ! (JUCE_WINDOWS || JUCE_ANDROID)
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <signal.h>
+ #include <errno.h>
+#endif
+
+LooperShared::LooperShared( Looper *looper_, const char *name_ ) : Thread("LooperShared"), looper(looper_),
+    segment(0), name(name_) {
+#if ! (JUCE_WINDOWS || JUCE_ANDROID)
+  //one already there belongs to another looper, unless that has gone. it is
+  //started over then, left to the other looper otherwise
+  int fd = shm_open( name_, O_CREAT | O_EXCL | O_RDWR, 0600 );
+  if( fd < 0 && errno == EEXIST ){
+    LooperSharedSegment *old = map( name_ );
+    bool gone = old && ( old->open.get() == 0 || ( kill( old->pid, 0 ) != 0 && errno == ESRCH ) );
+    unmap( old );
+    if( gone && shm_unlink( name_ ) == 0 ) fd = shm_open( name_, O_CREAT | O_EXCL | O_RDWR, 0600 );
+  }
+  if( fd < 0 ) return;
+  if( ftruncate( fd, sizeof(LooperSharedSegment) ) == 0 ){
+    void *p = mmap( 0, sizeof(LooperSharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( p != MAP_FAILED ) segment = (LooperSharedSegment*)p;
+  }
+  close( fd );
+  if( !segment ){
+    shm_unlink( name_ );
+    return;
+  }
+
+  //touches every page, the audio thread never faults on it
+  zeromem( segment, sizeof(LooperSharedSegment) );
+  for( unsigned int i=0; i < LOOPER_SHARED_COMMANDS; i++) segment->cells[i].sequence.set(i);
+  segment->magic = LOOPER_SHARED_MAGIC;
+  segment->version = LOOPER_SHARED_VERSION;
+  segment->size = sizeof(LooperSharedSegment);
+  segment->pid = (int32)getpid();
+  segment->open.set(1);
+  looper->share( segment );
+  startThread(5);
+#endif
+}
+
+LooperShared::~LooperShared(){
+  if( !segment ) return;
+  stopThread(1000);
+  looper->share(0);
+  //the name goes first, a looper starting meanwhile never sees it closed and still ours
+#if ! (JUCE_WINDOWS || JUCE_ANDROID)
+  shm_unlink( name.toUTF8() );
+#endif
+  segment->open.set(0);
+  unmap( segment );
+}
+
+LooperSharedSegment* LooperShared::map( const char *name ){
+#if ! (JUCE_WINDOWS || JUCE_ANDROID)
+  int fd = shm_open( name, O_RDWR, 0 );
+  if( fd < 0 ) return 0;
+  struct stat st;
+  void *p = MAP_FAILED;
+  if( fstat( fd, &st ) == 0 && st.st_size == (off_t)sizeof(LooperSharedSegment) )
+    p = mmap( 0, sizeof(LooperSharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( p == MAP_FAILED ) return 0;
+  LooperSharedSegment *s = (LooperSharedSegment*)p;
+  if( s->magic != LOOPER_SHARED_MAGIC || s->version != LOOPER_SHARED_VERSION ){
+    unmap( s );
+    return 0;
+  }
+  return s;
+#else
+  return 0;
+#endif
+}
+
+void LooperShared::unmap( LooperSharedSegment *s ){
+#if ! (JUCE_WINDOWS || JUCE_ANDROID)
+  if( s ) munmap( s, sizeof(LooperSharedSegment) );
+#endif
+}
+
+//the ring is polled rather than signalled, a controller never makes a system call
+void LooperShared::run(){
+  LooperSharedCommand c;
+  while( !threadShouldExit() ){
+    while( segment->pop( c ) ){
+      //a pointer from another process means nothing here
+      if( c.type < 0 || c.type >= LooperCommand::Load || c.loop < 0 || c.loop >= (int)looper->loops.size() ) continue;
+      looper->schedule( c.time, c.type, c.loop, c.value, c.value2 );
+    }
+    wait( LOOPER_SHARED_POLL );
+  }
+}
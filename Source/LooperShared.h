@@ -0,0 +1,128 @@
+
+#ifndef _LOOPERSHARED_H_
+#define _LOOPERSHARED_H_
+
+#include "Looper.h"
+
+//posix shared memory object, and the layout version processes check before using it
+#define LOOPER_SHARED_NAME "/loop-looper"
+#define LOOPER_SHARED_MAGIC 0x4c4f4f50
+#define LOOPER_SHARED_VERSION 2
+//loops in the state block, commands the ring holds, and ms between polls of the ring
+#define LOOPER_SHARED_LOOPS 64
+#define LOOPER_SHARED_COMMANDS 1024
+#define LOOPER_SHARED_POLL 1
+
+// a LooperOSC command from another process, handed to Looper::schedule
+struct LooperSharedCommand {
+  int32 type; //LooperCommand::Type, but Load and Extend
+  int32 loop;
+  float value, value2;
+  int64 time; //on Looper::clock(), state.clock tells where it is. 0 for as soon as possible
+};
+
+// what the audio thread publishes after every callback
+struct LooperSharedState {
+  int64 clock; //Looper::clock() after the callback
+  uint32 sampleRate;
+  uint32 numLoops; //entries of loops in use, at most LOOPER_SHARED_LOOPS
+  LooperMeter master;
+  LoopMeter loops[LOOPER_SHARED_LOOPS];
+};
+
+// the whole segment, the same plain data in every process that maps it.
+// controllers push commands into a ring (the LockFreeQueue algorithm laid
+// out in place) that the looper drains every LOOPER_SHARED_POLL ms. the
+// audio thread writes state under a seqlock and never waits for readers,
+// they copy it out and try again if the sequence moved meanwhile
+struct LooperSharedSegment {
+  uint32 magic, version, size;
+  Atomic<int32> open; //0 once the looper has gone
+  int32 pid; //of the looper's process, one that crashed leaves open set
+
+  char pad0[64];
+  Atomic<uint32> enqueuePos;
+  char pad1[64];
+  Atomic<uint32> dequeuePos;
+  char pad2[64];
+  struct Cell {
+    Atomic<uint32> sequence;
+    LooperSharedCommand command;
+  } cells[LOOPER_SHARED_COMMANDS];
+
+  char pad3[64];
+  Atomic<uint32> sequence; //odd while the state is being written
+  LooperSharedState state;
+
+  //any process, false if the ring is full
+  bool push( const LooperSharedCommand& c ){
+    Cell *cell;
+    uint32 pos = enqueuePos.get();
+    for(;;){
+      cell = &cells[pos % LOOPER_SHARED_COMMANDS];
+      int diff = (int)(cell->sequence.get() - pos);
+      if( diff == 0 ){
+        if( enqueuePos.compareAndSetBool( pos+1, pos ) ) break;
+      }else if( diff < 0 ) return false;
+      else pos = enqueuePos.get();
+    }
+    cell->command = c;
+    cell->sequence.set( pos+1 );
+    return true;
+  }
+
+  bool pop( LooperSharedCommand& c ){
+    Cell *cell;
+    uint32 pos = dequeuePos.get();
+    for(;;){
+      cell = &cells[pos % LOOPER_SHARED_COMMANDS];
+      int diff = (int)(cell->sequence.get() - (pos+1));
+      if( diff == 0 ){
+        if( dequeuePos.compareAndSetBool( pos+1, pos ) ) break;
+      }else if( diff < 0 ) return false;
+      else pos = dequeuePos.get();
+    }
+    c = cell->command;
+    cell->sequence.set( pos + LOOPER_SHARED_COMMANDS );
+    return true;
+  }
+
+  //a consistent copy of the state, false if the writer kept getting in the way
+  bool read( LooperSharedState& s, int tries = 16 ) const {
+    while( tries-- > 0 ){
+      uint32 before = sequence.get();
+      if( before & 1 ) continue;
+      memcpy( &s, &state, sizeof(s) );
+      if( sequence.get() == before ) return true;
+    }
+    return false;
+  }
+};
+
+// the looper's side: creates the segment, has the audio thread publish into
+// it and feeds the ring to the looper. not available on windows and android
+class LooperShared : private Thread {
+public:
+
+  LooperShared( Looper *looper, const char *name = LOOPER_SHARED_NAME );
+  ~LooperShared();
+
+  bool isOpen() const { return segment != 0; }
+
+  //for other processes: map an existing segment, 0 if there is none or its
+  //layout is not this one. unmap when done
+  static LooperSharedSegment* map( const char *name = LOOPER_SHARED_NAME );
+  static void unmap( LooperSharedSegment *segment );
+
+private:
+  Looper *looper;
+  LooperSharedSegment *segment;
+  String name;
+
+  void run();
+
+  LooperShared( const LooperShared& );
+  LooperShared& operator=( const LooperShared& );
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include "LooperTransfer.h"
+
+LooperTransfer::LooperTransfer( Looper *looper_ ) : Thread("LooperTransfer"), looper(looper_), numQueued(0) {
+  memory = new char[ LOOPER_TRANSFER_BURST * LOOPER_TRANSFER_DATAGRAM ];
+  startThread(2);
+}
+
+LooperTransfer::~LooperTransfer(){
+  signalThreadShouldExit();
+  notify();
+  stopThread(1000);
+  for( unsigned int i=0; i < uploads.size(); i++) delete uploads[i].image;
+  for( unsigned int i=0; i < downloads.size(); i++) delete downloads[i];
+  delete[] memory;
+}
+
+unsigned int LooperTransfer::chunkFrames( unsigned int numChannels ){
+  return LOOPER_TRANSFER_BYTES / (sizeof(float) * jlimit( 1u, (unsigned int)LOOP_MAX_CHANNELS, numChannels ));
+}
+
+void LooperTransfer::reply( const IpEndpointName& to, const osc::OutboundPacketStream& p ){
+  const char *d = p.Data();
+  int size = p.Size();
+  socket.SendMany( &to, &d, &size, 1 );
+}
+
+//a new begin for the same loop drops what was staged before
+void LooperTransfer::beginUpload( const IpEndpointName& client, int loop, int frames, int channels ){
+  char buffer[64];
+  osc::OutboundPacketStream p( buffer, sizeof(buffer) );
+  if( loop < 0 || loop >= (int)looper->loops.size() ) return;
+  const ScopedLock sl( lock );
+  if( (int)uploads.size() <= loop ){
+    Upload none;
+    none.image = 0;
+    uploads.resize( loop + 1, none );
+  }
+  Upload& u = uploads[loop];
+  delete u.image;
+  u.image = 0;
+  //never into the part of the pool kept for recording
+  uint64 needed = ( ((uint64)frames + LOOP_CHUNK_MASK) >> LOOP_CHUNK_BITS ) * (uint64)channels;
+  if( frames <= 0 || channels < 1 || channels > LOOP_MAX_CHANNELS || needed > looper->spareChunks() ){
+    p << osc::BeginMessage( "/loop/upload/failed" ) << loop << osc::EndMessage;
+    return reply( client, p );
+  }
+  u.image = new LoopImage( &looper->pool, channels, looper->sampleRate );
+  if( !u.image->resize( frames ) ){
+    delete u.image;
+    u.image = 0;
+    p << osc::BeginMessage( "/loop/upload/failed" ) << loop << osc::EndMessage;
+    return reply( client, p );
+  }
+  unsigned int cf = chunkFrames( channels );
+  u.client = client;
+  u.received.assign( (frames + cf - 1) / cf, false );
+  u.used = Time::getMillisecondCounter();
+  p << osc::BeginMessage( "/loop/upload/ready" ) << loop << (osc::int32)cf << osc::EndMessage;
+  reply( client, p );
+}
+
+void LooperTransfer::upload( const IpEndpointName& client, int loop, int offset, const void *blob, unsigned long size ){
+  const ScopedLock sl( lock );
+  if( loop < 0 || loop >= (int)uploads.size() ) return;
+  Upload& u = uploads[loop];
+  LoopImage *image = u.image;
+  if( !image || client != u.client ) return;
+  unsigned int cf = chunkFrames( image->numChannels );
+  if( offset < 0 || (unsigned int)offset >= image->numSamples || offset % cf ) return;
+  unsigned int frames = jmin( cf, image->numSamples - offset );
+  if( size != frames * image->numChannels * sizeof(float) || u.received[ offset / cf ] ) return;
+
+  const char *s = (const char*)blob;
+  for( unsigned int f=0; f < frames; f++)
+    for( unsigned int c=0; c < image->numChannels; c++, s += 4){
+      uint32 bits = ByteOrder::bigEndianInt( s );
+      memcpy( image->at( c, offset + f ), &bits, sizeof(float) );
+    }
+  u.received[ offset / cf ] = true;
+  u.used = Time::getMillisecondCounter();
+}
+
+void LooperTransfer::endUpload( const IpEndpointName& client, int loop ){
+  char buffer[LOOPER_TRANSFER_MISSING][64];
+  IpEndpointName to[LOOPER_TRANSFER_MISSING];
+  const char *d[LOOPER_TRANSFER_MISSING];
+  int sizes_[LOOPER_TRANSFER_MISSING];
+  int n = 0;
+
+  const ScopedLock sl( lock );
+  if( loop < 0 || loop >= (int)uploads.size() || !uploads[loop].image || client != uploads[loop].client ){
+    osc::OutboundPacketStream p( buffer[0], sizeof(buffer[0]) );
+    p << osc::BeginMessage( "/loop/upload/failed" ) << loop << osc::EndMessage;
+    return reply( client, p );
+  }
+  Upload& u = uploads[loop];
+  u.used = Time::getMillisecondCounter();
+  for( unsigned int k=0; k < u.received.size() && n < LOOPER_TRANSFER_MISSING; ){
+    if( u.received[k] ){ k++; continue; }
+    unsigned int first = k;
+    while( k < u.received.size() && !u.received[k] ) k++;
+    osc::OutboundPacketStream p( buffer[n], sizeof(buffer[n]) );
+    p << osc::BeginMessage( "/loop/upload/missing" ) << loop << (osc::int32)first << (osc::int32)(k - first) << osc::EndMessage;
+    to[n] = client;
+    d[n] = p.Data();
+    sizes_[n] = p.Size();
+    n++;
+  }
+  if( n > 0 ){
+    socket.SendMany( to, d, sizes_, n );
+    return;
+  }
+
+  unsigned int frames = u.image->numSamples;
+  looper->load( loop, u.image );
+  u.image = 0;
+  u.received.clear();
+  osc::OutboundPacketStream p( buffer[0], sizeof(buffer[0]) );
+  p << osc::BeginMessage( "/loop/upload/done" ) << loop << (osc::int32)frames << osc::EndMessage;
+  reply( client, p );
+}
+
+void LooperTransfer::download( const IpEndpointName& client, int loop, int first, int count ){
+  if( loop < 0 || loop >= (int)looper->loops.size() || first < 0 ) return;
+  Job job;
+  job.client = client;
+  job.loop = loop;
+  job.first = first;
+  job.count = count;
+  {
+    const ScopedLock sl( lock );
+    jobs.push_back( job );
+  }
+  notify();
+}
+
+void LooperTransfer::run(){
+  while( !threadShouldExit() ){
+    Job job;
+    bool have = false;
+    {
+      const ScopedLock sl( lock );
+      if( !jobs.empty() ){
+        job = jobs.front();
+        jobs.pop_front();
+        have = true;
+      }
+    }
+    if( have ) serve( job );
+    else wait( LOOPER_TRANSFER_TIMEOUT / 4 );
+    expire();
+  }
+}
+
+void LooperTransfer::expire(){
+  uint32 now = Time::getMillisecondCounter();
+  for( unsigned int i=0; i < downloads.size(); i++)
+    if( downloads[i] && now - downloads[i]->used > LOOPER_TRANSFER_TIMEOUT ){
+      delete downloads[i];
+      downloads[i] = 0;
+    }
+  const ScopedLock sl( lock );
+  for( unsigned int i=0; i < uploads.size(); i++){
+    Upload& u = uploads[i];
+    if( !u.image || now - u.used <= LOOPER_TRANSFER_TIMEOUT ) continue;
+    delete u.image;
+    u.image = 0;
+    u.received.clear();
+  }
+}
+
+void LooperTransfer::queue( const IpEndpointName& to, const osc::OutboundPacketStream& p ){
+  destinations[numQueued] = to;
+  data[numQueued] = p.Data();
+  sizes[numQueued] = p.Size();
+  if( ++numQueued == LOOPER_TRANSFER_BURST ) flush();
+}
+
+void LooperTransfer::flush(){
+  if( numQueued == 0 ) return;
+  socket.SendMany( destinations, data, sizes, numQueued );
+  numQueued = 0;
+  wait( LOOPER_TRANSFER_PAUSE );
+}
+
+//a download takes a new snapshot, resends are served from the one it took
+void LooperTransfer::serve( const Job& job ){
+  if( (int)downloads.size() <= job.loop ) downloads.resize( job.loop + 1, 0 );
+  Download *d = downloads[job.loop];
+  if( job.count < 0 || !d ){
+    delete d;
+    downloads[job.loop] = d = new Download();
+    if( !looper->snapshot( job.loop, d->data, d->channels, d->size, LOOPER_TRANSFER_WAIT ) ){
+      delete d;
+      downloads[job.loop] = 0;
+      osc::OutboundPacketStream p( slot(), LOOPER_TRANSFER_DATAGRAM );
+      p << osc::BeginMessage( "/loop/download/failed" ) << job.loop << osc::EndMessage;
+      queue( job.client, p );
+      flush();
+      return;
+    }
+  }
+  d->used = Time::getMillisecondCounter();
+  unsigned int frames = d->size, channels = d->channels;
+  unsigned int cf = chunkFrames( channels );
+  unsigned int numBlobs = (frames + cf - 1) / cf;
+  unsigned int first = jmin( (unsigned int)job.first, numBlobs );
+  unsigned int end = job.count < 0 ? numBlobs : jmin( numBlobs, first + job.count );
+
+  if( job.count < 0 ){
+    osc::OutboundPacketStream p( slot(), LOOPER_TRANSFER_DATAGRAM );
+    p << osc::BeginMessage( "/loop/download/begin" ) << job.loop << (osc::int32)frames
+      << (osc::int32)channels << (osc::int32)looper->loops[job.loop]->sampleRate << (osc::int32)cf << osc::EndMessage;
+    queue( job.client, p );
+  }
+
+  char blob[LOOPER_TRANSFER_BYTES];
+  for( unsigned int k=first; k < end && !threadShouldExit(); k++){
+    unsigned int offset = k * cf;
+    unsigned int n = jmin( cf, frames - offset );
+    char *b = blob;
+    for( unsigned int f=0; f < n; f++)
+      for( unsigned int c=0; c < channels; c++, b += 4){
+        uint32 bits;
+        memcpy( &bits, d->data + c * frames + offset + f, sizeof(float) );
+        bits = ByteOrder::swapIfLittleEndian( bits );
+        memcpy( b, &bits, 4 );
+      }
+    osc::OutboundPacketStream p( slot(), LOOPER_TRANSFER_DATAGRAM );
+    p << osc::BeginMessage( "/loop/data" ) << job.loop << (osc::int32)offset
+      << osc::Blob( blob, b - blob ) << osc::EndMessage;
+    queue( job.client, p );
+  }
+
+  osc::OutboundPacketStream p( slot(), LOOPER_TRANSFER_DATAGRAM );
+  p << osc::BeginMessage( "/loop/download/end" ) << job.loop << (osc::int32)frames << osc::EndMessage;
+  queue( job.client, p );
+  flush();
+}
@@ -0,0 +1,114 @@
+
+#ifndef _LOOPERTRANSFER_H_
+#define _LOOPERTRANSFER_H_
+
+#include <vector>
+#include <deque>
+
+#include "Looper.h"
+#include "ip/UdpSocket.h"
+#include "osc/OscOutboundPacketStream.h"
+
+//audio bytes per datagram, what is left of a 1472 byte one after the message around it
+#define LOOPER_TRANSFER_BYTES 1408
+#define LOOPER_TRANSFER_DATAGRAM 1472
+//datagrams sent back to back, and the pause after each burst in ms so receivers keep up
+#define LOOPER_TRANSFER_BURST 32
+#define LOOPER_TRANSFER_PAUSE 1
+//missing runs reported per /loop/upload/end, ending again gets the next ones
+#define LOOPER_TRANSFER_MISSING 64
+//ms a download waits for its loop to be held still, see Looper::snapshot, and
+//ms without a message about it before a staged upload or a download's copy goes
+#define LOOPER_TRANSFER_WAIT 2000
+#define LOOPER_TRANSFER_TIMEOUT 30000
+
+// loop audio over osc. blobs hold interleaved big endian float frames, all
+// chunkFrames long but the last, and a blob's sequence number is its offset
+// in frames / chunkFrames. lost blobs are asked for again by number.
+//
+// upload, client to looper:
+//   /loop/upload/begin i frames channels  -> /loop/upload/ready i chunkFrames, or
+//                                            /loop/upload/failed i if it does not fit
+//                                            short of the recording reserve
+//   /loop/upload i offset blob            in any order, repeats are ignored
+//   /loop/upload/end i                    -> /loop/upload/missing i first count per run
+//                                            not received, or /loop/upload/done i frames
+//   blobs go straight into pool chunks as they arrive, on the receive thread.
+//   once all are in the staged audio replaces loop i's with Looper::load. an
+//   upload left alone for LOOPER_TRANSFER_TIMEOUT ms is dropped
+//
+// download, looper to client:
+//   /loop/download i                      -> /loop/download/begin i frames channels
+//                                            sampleRate chunkFrames, a /loop/data i offset
+//                                            blob per chunk, /loop/download/end i frames,
+//                                            or /loop/download/failed i
+//   /loop/download/resend i first count   -> those blobs again and another end
+//   sent paced from a thread of its own, out of a snapshot of the loop taken
+//   when the download begins (Looper::snapshot). resends come from the same one
+//   until LOOPER_TRANSFER_TIMEOUT ms pass without any
+//
+// replies go to the endpoint the request came from
+class LooperTransfer : private Thread {
+public:
+
+  LooperTransfer( Looper *looper );
+  ~LooperTransfer();
+
+  static unsigned int chunkFrames( unsigned int numChannels );
+
+  //osc receive thread
+  void beginUpload( const IpEndpointName& client, int loop, int frames, int channels );
+  void upload( const IpEndpointName& client, int loop, int offset, const void *data, unsigned long size );
+  void endUpload( const IpEndpointName& client, int loop );
+  //count < 0 for the whole loop with the begin message
+  void download( const IpEndpointName& client, int loop, int first, int count );
+
+private:
+  struct Upload {
+    LoopImage *image;
+    IpEndpointName client;
+    std::vector<bool> received; //per blob
+    uint32 used; //ms counter at the last message about it
+  };
+  //a loop as it was when its download began
+  struct Download {
+    HeapBlock<float> data; //planar
+    unsigned int channels, size;
+    uint32 used;
+  };
+  struct Job {
+    IpEndpointName client;
+    int loop;
+    int first, count;
+  };
+
+  Looper *looper;
+  UdpSocket socket;
+  std::vector<Download*> downloads; //by loop, send thread only
+
+  CriticalSection lock;
+  std::vector<Upload> uploads; //by loop
+  std::deque<Job> jobs;
+
+  //send thread's burst
+  char *memory;
+  IpEndpointName destinations[LOOPER_TRANSFER_BURST];
+  const char *data[LOOPER_TRANSFER_BURST];
+  int sizes[LOOPER_TRANSFER_BURST];
+  unsigned int numQueued;
+
+  void run();
+  void serve( const Job& job );
+  //let go of what has been left alone too long, send thread
+  void expire();
+  //datagrams built in memory go out a burst at a time
+  char* slot() const { return memory + numQueued * LOOPER_TRANSFER_DATAGRAM; }
+  void queue( const IpEndpointName& to, const osc::OutboundPacketStream& p );
+  void flush();
+  void reply( const IpEndpointName& to, const osc::OutboundPacketStream& p );
+
+  LooperTransfer( const LooperTransfer& );
+  LooperTransfer& operator=( const LooperTransfer& );
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <string.h>
+
+#include "OscDispatch.h"
+
+OscAddressTable::OscAddressTable() : seed(0), mask(0) {}
+
+void OscAddressTable::add( const char *address, int id ){
+  names.push_back( address );
+  ids.push_back( id );
+}
+
+//fnv-1a, the seed goes in first
+uint32 OscAddressTable::hash( const char *s, uint32 seed ){
+  uint32 h = 2166136261u ^ seed;
+  for( ; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+  return h ^ (h >> 15);
+}
+
+void OscAddressTable::build(){
+  //twice as many slots as addresses, more if no seed separates them
+  unsigned int size = 1;
+  while( size < 2 * names.size() ) size <<= 1;
+  for( ;; size <<= 1 ){
+    slots.assign( size, -1 );
+    mask = size - 1;
+    for( seed = 1; seed < 1024; seed++){
+      unsigned int i = 0;
+      for( ; i < names.size(); i++){
+        int& s = slots[ hash( names[i].c_str(), seed ) & mask ];
+        if( s >= 0 ) break;
+        s = i;
+      }
+      if( i == names.size() ) return;
+      slots.assign( size, -1 );
+    }
+  }
+}
+
+int OscAddressTable::find( const char *address ) const {
+  if( slots.empty() ) return -1;
+  int s = slots[ hash( address, seed ) & mask ];
+  return s >= 0 && names[s] == address ? ids[s] : -1;
+}
+
+bool OscPattern::isPattern( const char *a ){
+  return strpbrk( a, "*?[]{}" ) != 0;
+}
+
+bool OscPattern::compile( const char *p ){
+  tokens.clear();
+  while( *p ){
+    Token t;
+    switch( *p ){
+      case '?': t.type = Token::One; p++; break;
+      case '*':
+        t.type = Token::Star;
+        while( *p == '*' ) p++;
+        break;
+      case '[': {
+        t.type = Token::Set;
+        p++;
+        bool negate = *p == '!';
+        if( negate ) p++;
+        zeromem( t.set, sizeof(t.set) );
+        while( *p && *p != ']' ){
+          unsigned char lo = *p, hi = lo;
+          if( p[1] == '-' && p[2] && p[2] != ']' ){ hi = p[2]; p += 2; }
+          if( lo > hi ){ unsigned char s = lo; lo = hi; hi = s; }
+          for( unsigned int c = lo; c <= hi; c++) t.set[c >> 5] |= 1u << (c & 31);
+          p++;
+        }
+        if( *p != ']' ){ tokens.clear(); return false; }
+        p++;
+        if( negate ) for( int i=0; i < 8; i++) t.set[i] = ~t.set[i];
+        //sets never match the separator
+        t.set['/' >> 5] &= ~(1u << ('/' & 31));
+        break;
+      }
+      case '{': {
+        t.type = Token::Choice;
+        const char *end = strchr( p, '}' );
+        if( !end ){ tokens.clear(); return false; }
+        for( const char *s = p + 1; s <= end; ){
+          const char *e = s;
+          while( e < end && *e != ',' ) e++;
+          t.choices.push_back( std::string( s, e ) );
+          s = e + 1;
+        }
+        p = end + 1;
+        break;
+      }
+      case ']': case '}': tokens.clear(); return false;
+      default: {
+        size_t n = strcspn( p, "*?[]{}" );
+        if( !tokens.empty() && tokens.back().type == Token::Literal ){
+          tokens.back().text.append( p, n );
+          p += n;
+          continue;
+        }
+        t.type = Token::Literal;
+        t.text.assign( p, n );
+        p += n;
+      }
+    }
+    tokens.push_back( t );
+  }
+  return true;
+}
+
+bool OscPattern::matches( const char *address ) const {
+  return !tokens.empty() && match( 0, address );
+}
+
+//backtracks only at * and {}, both of which stay inside one part of the address
+bool OscPattern::match( unsigned int t, const char *a ) const {
+  for( ; t < tokens.size(); t++){
+    const Token& k = tokens[t];
+    switch( k.type ){
+      case Token::Literal:
+        if( strncmp( a, k.text.c_str(), k.text.size() ) ) return false;
+        a += k.text.size();
+        break;
+      case Token::One:
+        if( !*a || *a == '/' ) return false;
+        a++;
+        break;
+      case Token::Set: {
+        unsigned char c = *a;
+        if( !c || !(k.set[c >> 5] & (1u << (c & 31))) ) return false;
+        a++;
+        break;
+      }
+      case Token::Choice:
+        for( unsigned int i=0; i < k.choices.size(); i++){
+          const std::string& c = k.choices[i];
+          if( !strncmp( a, c.c_str(), c.size() ) && match( t + 1, a + c.size() ) ) return true;
+        }
+        return false;
+      case Token::Star:
+        for( const char *p = a; ; p++){
+          if( match( t + 1, p ) ) return true;
+          if( !*p || *p == '/' ) return false;
+        }
+    }
+  }
+  return *a == 0;
+}
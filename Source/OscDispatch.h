@@ -0,0 +1,215 @@
+
+#ifndef _OSCDISPATCH_H_
+#define _OSCDISPATCH_H_
+
+#include <vector>
+#include <string>
+#include <string.h>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "osc/OscReceivedElements.h"
+
+// fixed set of osc addresses, looked up with one hash and one strcmp. build
+// picks a hash seed that puts every address in its own slot, so there are
+// no chains to walk. add and build at startup, find from any thread after.
+class OscAddressTable {
+public:
+
+  OscAddressTable();
+
+  void add( const char *address, int id );
+  void build();
+
+  //id of address, -1 if it was not added
+  int find( const char *address ) const;
+
+  unsigned int size() const { return names.size(); }
+  const char* address( unsigned int i ) const { return names[i].c_str(); }
+  int id( unsigned int i ) const { return ids[i]; }
+
+private:
+  std::vector<std::string> names;
+  std::vector<int> ids;
+  std::vector<int> slots; //index into names, -1 for empty
+  uint32 seed, mask;
+
+  static uint32 hash( const char *s, uint32 seed );
+};
+
+// osc 1.0 address pattern, parsed once into tokens so matching does not
+// have to scan the pattern again: ? and * within a part of the address,
+// [a-z] and [!a-z] sets and {foo,bar} choices
+class OscPattern {
+public:
+
+  //true if address has any of the characters above
+  static bool isPattern( const char *address );
+
+  //false for malformed patterns, which then match nothing
+  bool compile( const char *pattern );
+  bool matches( const char *address ) const;
+
+private:
+  struct Token {
+    enum Type { Literal, One, Star, Set, Choice };
+    Type type;
+    std::string text;
+    uint32 set[8]; //256 bits
+    std::vector<std::string> choices;
+  };
+  std::vector<Token> tokens;
+
+  bool match( unsigned int t, const char *a ) const;
+};
+
+//what OscHandlers::call did
+enum OscCallResult { OscCalled = 0, OscUnknownHandler, OscWrongArguments };
+
+//type tag of a handler argument type and how to read one once the tag is checked
+template <typename A> struct OscArg;
+template <> struct OscArg<osc::int32> {
+  enum { tag = 'i' };
+  static osc::int32 get( const osc::ReceivedMessageArgument& a ){ return a.AsInt32Unchecked(); }
+};
+template <> struct OscArg<osc::int64> {
+  enum { tag = 'h' };
+  static osc::int64 get( const osc::ReceivedMessageArgument& a ){ return a.AsInt64Unchecked(); }
+};
+template <> struct OscArg<float> {
+  enum { tag = 'f' };
+  static float get( const osc::ReceivedMessageArgument& a ){ return a.AsFloatUnchecked(); }
+};
+template <> struct OscArg<double> {
+  enum { tag = 'd' };
+  static double get( const osc::ReceivedMessageArgument& a ){ return a.AsDoubleUnchecked(); }
+};
+template <> struct OscArg<const char*> {
+  enum { tag = 's' };
+  static const char* get( const osc::ReceivedMessageArgument& a ){ return a.AsStringUnchecked(); }
+};
+//points into the packet, valid while the handler runs
+template <> struct OscArg<osc::Blob> {
+  enum { tag = 'b' };
+  static osc::Blob get( const osc::ReceivedMessageArgument& a ){
+    osc::Blob b;
+    a.AsBlobUnchecked( b.data, b.size );
+    return b;
+  }
+};
+
+// osc addresses bound to member functions of a target, with the argument
+// types taken from the function: bind( "/gain", &T::setGain ) for
+// void T::setGain( float ). a message's type tags are compared with the
+// handler's once, then the arguments are read straight into the call with
+// no further checks. ReceivedMessage has validated them already. nothing
+// here throws, mismatches come back as OscWrongArguments.
+// up to 3 arguments
+template <class T>
+class OscHandlers {
+public:
+
+  OscHandlers( T *target_ ) : target(target_) {}
+  ~OscHandlers(){
+    for( unsigned int h=0; h < handlers.size(); h++) delete handlers[h].binder;
+  }
+
+  void bind( const char *address, void (T::*f)() ){
+    add( address, "", new Binder0( f ) );
+  }
+  template <class A>
+  void bind( const char *address, void (T::*f)( A ) ){
+    const char sig[] = { (char)OscArg<A>::tag, 0 };
+    add( address, sig, new Binder1<A>( f ) );
+  }
+  template <class A, class B>
+  void bind( const char *address, void (T::*f)( A, B ) ){
+    const char sig[] = { (char)OscArg<A>::tag, (char)OscArg<B>::tag, 0 };
+    add( address, sig, new Binder2<A,B>( f ) );
+  }
+  template <class A, class B, class C>
+  void bind( const char *address, void (T::*f)( A, B, C ) ){
+    const char sig[] = { (char)OscArg<A>::tag, (char)OscArg<B>::tag, (char)OscArg<C>::tag, 0 };
+    add( address, sig, new Binder3<A,B,C>( f ) );
+  }
+
+  //after the last bind
+  void build(){ table.build(); }
+
+  //handler index of address, -1 if none
+  int find( const char *address ) const { return table.find( address ); }
+  unsigned int size() const { return handlers.size(); }
+  const char* address( unsigned int h ) const { return table.address( h ); }
+
+  //call handler h with the arguments from args on, tags being their type tags
+  //(0 for none). they have to be exactly the handler's
+  OscCallResult call( int h, const char *tags, osc::ReceivedMessageArgumentIterator args ) const {
+    if( h < 0 || h >= (int)handlers.size() ) return OscUnknownHandler;
+    const Handler& handler = handlers[h];
+    if( strcmp( tags ? tags : "", handler.signature ) != 0 ) return OscWrongArguments;
+    handler.binder->call( *target, args );
+    return OscCalled;
+  }
+
+private:
+  //a member function kept with its own type, reading its arguments
+  struct Binder {
+    virtual ~Binder(){}
+    virtual void call( T& t, osc::ReceivedMessageArgumentIterator i ) const = 0;
+  };
+  struct Binder0 : Binder {
+    void (T::*f)();
+    Binder0( void (T::*f_)() ) : f(f_) {}
+    void call( T& t, osc::ReceivedMessageArgumentIterator ) const { (t.*f)(); }
+  };
+  template <class A>
+  struct Binder1 : Binder {
+    void (T::*f)( A );
+    Binder1( void (T::*f_)( A ) ) : f(f_) {}
+    void call( T& t, osc::ReceivedMessageArgumentIterator i ) const {
+      A a = OscArg<A>::get( *i );
+      (t.*f)( a );
+    }
+  };
+  template <class A, class B>
+  struct Binder2 : Binder {
+    void (T::*f)( A, B );
+    Binder2( void (T::*f_)( A, B ) ) : f(f_) {}
+    void call( T& t, osc::ReceivedMessageArgumentIterator i ) const {
+      A a = OscArg<A>::get( *i ); ++i;
+      B b = OscArg<B>::get( *i );
+      (t.*f)( a, b );
+    }
+  };
+  template <class A, class B, class C>
+  struct Binder3 : Binder {
+    void (T::*f)( A, B, C );
+    Binder3( void (T::*f_)( A, B, C ) ) : f(f_) {}
+    void call( T& t, osc::ReceivedMessageArgumentIterator i ) const {
+      A a = OscArg<A>::get( *i ); ++i;
+      B b = OscArg<B>::get( *i ); ++i;
+      C c = OscArg<C>::get( *i );
+      (t.*f)( a, b, c );
+    }
+  };
+  struct Handler {
+    char signature[4];
+    Binder *binder; //owned
+  };
+
+  T *target;
+  OscAddressTable table;
+  std::vector<Handler> handlers;
+
+  void add( const char *address, const char *signature, Binder *binder ){
+    Handler h;
+    strcpy( h.signature, signature );
+    h.binder = binder;
+    table.add( address, handlers.size() );
+    handlers.push_back( h );
+  }
+
+  OscHandlers( const OscHandlers& );
+  OscHandlers& operator=( const OscHandlers& );
+};
+
+#endif
@@ -20,6 +20,10 @@
 */
 
 //[Headers] You can add your own extra header files here...
+#include "LooperShared.h"
+#include "LooperSession.h"
+#include "LooperImport.h"
+#include "LooperExport.h"
 //[/Headers]
 
 #include "RangLoopComponent.h"
@@ -189,7 +193,8 @@ RangLoopComponent::RangLoopComponent ()
 
     char* id[16] = {"1","2","3","4","Q","W","E","R","A","S","D","F","Z","X","C","V"};
     for( int i=0; i < 16; i++){
-        LoopComponent *loopComp = new LoopComponent( looper.newLoop(), id[i]);
+        looper.newLoop();
+        LoopComponent *loopComp = new LoopComponent( &looper, i, id[i]);
         loopComps.push_back( loopComp );
     }
     addAndMakeVisible (loopComp1 = loopComps[0]);
@@ -354,7 +359,7 @@ RangLoopComponent::RangLoopComponent ()
   curLoop = 0;
 
 
-    const String error (audioDeviceManager.initialise (1, /* number of input channels */
+    const String error (audioDeviceManager.initialise (2, /* number of input channels */
                                                        2, /* number of output channels */
                                                        0, /* no XML settings.. */
                                                        true  /* select default device on failure */));
@@ -385,6 +390,23 @@ RangLoopComponent::RangLoopComponent ()
     
     osc = new RangOSC( &looper );
     osc->startThread();
+    shared = new LooperShared( &looper );
+    session = new LooperSession( &looper );
+    import = new LooperImport( &looper );
+    for( int i=0; i < loopComps.size(); i++) loopComps[i]->import = import;
+    exporter = new LooperExport( &looper );
+    //autosaves go to a new file each run until a session is saved or loaded, the
+    //last few with audio are kept and the newest is offered back. LOOP_NO_AUTOSAVE
+    //in the environment turns them off
+    if( !getenv( "LOOP_NO_AUTOSAVE" ) ){
+      File folder = File::getSpecialLocation( File::userApplicationDataDirectory ).getChildFile( "Loop/autosaves" );
+      Array<File> autosaves = LooperSession::autosaves( folder );
+      session->save( LooperSession::nextAutosave( folder ) );
+      if( autosaves.size() > 0 )
+        AlertWindow::showOkCancelBox( AlertWindow::QuestionIcon, "Autosave",
+          "Load the loops autosaved " + autosaves[0].getLastModificationTime().toString( true, true, false ) + "?",
+          "Load", "Start empty", 0, ModalCallbackFunction::forComponent( autosaveChosen, this, autosaves[0] ) );
+    }
     
     //[/Constructor]
 }
@@ -397,6 +419,11 @@ RangLoopComponent::~RangLoopComponent()
     audioDeviceManager.removeAudioCallback (audioInDispComp);
 	audioDeviceManager.removeAudioCallback (audioOutDispComp);
     recorder = 0;
+    delete shared;
+    for( int i=0; i < loopComps.size(); i++) loopComps[i]->import = 0;
+    delete import;
+    delete exporter;
+    delete session;
   //audioDeviceManager.stopDevice();
 
 	//deleteAndZero(deviceSelector);
@@ -566,38 +593,41 @@ void RangLoopComponent::buttonClicked (Button* buttonThatWasClicked)
     else if (buttonThatWasClicked == playpauseButton)
     {
         //[UserButtonCode_playpauseButton] -- add your button handler code here..
-      if( looper(curLoop)->playing ) stop();
+      if( looper.meter(curLoop).flags & LoopMeter::Playing ) stop();
       else play();
         //[/UserButtonCode_playpauseButton]
     }
     else if (buttonThatWasClicked == savesessionButton)
     {
         //[UserButtonCode_savesessionButton] -- add your button handler code here..
+        FileChooser chooser( "Save session", File("~/Desktop/session.loops"), "*.loops" );
+        if( chooser.browseForFileToSave(true) && !session->save( chooser.getResult() ) )
+          AlertWindow::showMessageBoxAsync( AlertWindow::WarningIcon, "Save session", "Couldn't write " + chooser.getResult().getFullPathName() );
         //[/UserButtonCode_savesessionButton]
     }
     else if (buttonThatWasClicked == loadsessionButton)
     {
         //[UserButtonCode_loadsessionButton] -- add your button handler code here..
+        FileChooser chooser( "Load session", File("~/Desktop"), "*.loops" );
+        if( chooser.browseForFileToOpen() && !session->load( chooser.getResult() ) )
+          AlertWindow::showMessageBoxAsync( AlertWindow::WarningIcon, "Load session", chooser.getResult().getFileName() + " is not a session" );
         //[/UserButtonCode_loadsessionButton]
     }
     else if (buttonThatWasClicked == saveloopButton)
     {
         //[UserButtonCode_saveloopButton] -- add your button handler code here..
+        FileChooser chooser( "Export loops", File("~/Desktop/loops.wav"), exporter->getWildcard() );
+        if( chooser.browseForFileToSave(false) && exporter->exportAll( chooser.getResult() ) == 0 )
+          AlertWindow::showMessageBoxAsync( AlertWindow::WarningIcon, "Export loops",
+            exporter->isBusy() ? "The last export is still going" : "No loop has anything to export" );
         //[/UserButtonCode_saveloopButton]
     }
     else if (buttonThatWasClicked == loadloopButton)
     {
         //[UserButtonCode_loadloopButton] -- add your button handler code here..
-        
-        AudioFormatManager formatManager;
-        formatManager.registerBasicFormats();
-        
-        //ScopedPointer<AudioFormatReader> reader = formatManager.createReaderFor (audioFile);
-        
-        //if (reader != 0){
-            
-        //}
-
+        FileChooser chooser( "Load loop", File("~/Desktop"), import->getWildcard() );
+        if( chooser.browseForFileToOpen() && !import->import( curLoop, chooser.getResult() ) )
+          AlertWindow::showMessageBoxAsync( AlertWindow::WarningIcon, "Load loop", "Couldn't read " + chooser.getResult().getFileName() );
         //[/UserButtonCode_loadloopButton]
     }
     else if (buttonThatWasClicked == recordsessionButton)
@@ -617,6 +647,7 @@ void RangLoopComponent::buttonClicked (Button* buttonThatWasClicked)
     {
         //[UserButtonCode_recordoutButton] -- add your button handler code here..
         recordoutButton->setToggleState( !recordoutButton->getToggleState(), false);
+        looper.setRecordOutput( curLoop, recordoutButton->getToggleState() );
         //[/UserButtonCode_recordoutButton]
     }
 
@@ -635,11 +666,7 @@ void RangLoopComponent::sliderValueChanged (Slider* sliderThatWasMoved)
         float min = slider->getMinValue() / slider->getMaximum();
         float max = slider->getMaxValue() / slider->getMaximum();
         //float pos = slider->getValue() / slider->getMaximum();
-        Loop* loop = looper(curLoop);
-        
-        loop->b[0].rMin = min * loop->b[0].curSize;
-        loop->b[0].rMax = max * loop->b[0].curSize;
-        //loop->b[0].rPos = pos * loop->b[0].curSize;
+        looper.setBounds( curLoop, min, max );
         
         //[/UserSliderCode_slider]
     }
@@ -725,7 +752,7 @@ bool RangLoopComponent::keyPressed (const KeyPress& key)
 
 
 	if ( code == KeyPress::deleteKey || code == KeyPress::escapeKey ){
-		if( looper(curLoop)->playing ) stop();
+		if( looper.meter(curLoop).flags & LoopMeter::Playing ) stop();
 		else play();
 		return true;
 
@@ -739,11 +766,11 @@ bool RangLoopComponent::keyPressed (const KeyPress& key)
 
 	}else if( code == KeyPress::pageUpKey){
 		//switchLoop();
-		if( !looper(curLoop)->recording ) toggleRecord();
+		if( !(looper.meter(curLoop).flags & LoopMeter::Recording) ) toggleRecord();
 		return true;
 
 	}else if( code == KeyPress::spaceKey ){
-			if( !looper(curLoop)->playing )  toggleRecord();
+			if( !(looper.meter(curLoop).flags & LoopMeter::Playing) )  toggleRecord();
 			else toggleStack();
 			return true;
 	}
@@ -798,51 +825,46 @@ update:
 
 void RangLoopComponent::play(){
 
-  looper(curLoop)->rewind();
-  looper(curLoop)->play();
+  looper.rewind(curLoop);
+  looper.play(curLoop);
 
 }
 void RangLoopComponent::stop(){
-	looper(curLoop)->stop();
+	looper.stop(curLoop);
 }
 
 void RangLoopComponent::toggleRecord(){
 
-	if(!looper(curLoop)->recording){
-		int sampleRate = audioDeviceManager.getCurrentAudioDevice()->getCurrentSampleRate();
-		if( looper(curLoop)->numSamples == 0 ){
-            looper(curLoop)->allocate( sampleRate * 10.f );
-        }else looper(curLoop)->clear();
+	if( !(looper.meter(curLoop).flags & LoopMeter::Recording) ){
 
 		recordButton->setToggleState(true,false);
 
-        looper(curLoop)->stop();
-        looper(curLoop)->record();
+        looper.record(curLoop);
 
 	}else{
 
-        looper(curLoop)->stop();
+        looper.stop(curLoop);
 		recordButton->setToggleState(false,false);
         recordoutButton->setToggleState(false,false);
+        looper.setRecordOutput(curLoop, false);
 		play();
 	}
 
 }
+//the buttons follow the meter once the audio thread has applied it, see updateControls
 void RangLoopComponent::toggleStack(){
-    looper(curLoop)->stack();
-	stackButton->setToggleState(looper(curLoop)->stacking,false);
+    looper.stack(curLoop);
 }
 void RangLoopComponent::toggleReverse(){
 
-    looper(curLoop)->reverse();
-    reverseButton->setToggleState(looper(curLoop)->reversing,false);
+    looper.reverse(curLoop);
 
 }
 void RangLoopComponent::switchLoop(int index){
 
-    if( index == curLoop ) looper(curLoop)->playing = !looper(curLoop)->playing && looper(curLoop)->numSamples;
+    if( index == curLoop ) looper.togglePlay(curLoop);
 
-	if( looper(curLoop)->recording ) toggleRecord();
+	if( looper.meter(curLoop).flags & LoopMeter::Recording ) toggleRecord();
     loopComps[curLoop]->selected = false;
 
     curLoop = index;
@@ -851,23 +873,27 @@ void RangLoopComponent::switchLoop(int index){
 
 }
 void RangLoopComponent::updateLoop(){
-    looper(curLoop)->decay = 1.f - decayKnob->getValue()/decayKnob->getMaximum();
-    looper(curLoop)->gain = 3.f * volumeKnob->getValue()/volumeKnob->getMaximum();
-    looper(curLoop)->pan = panKnob->getValue()/panKnob->getMaximum();
+    looper.setDecay( curLoop, 1.f - decayKnob->getValue()/decayKnob->getMaximum() );
+    looper.setGain( curLoop, 3.f * volumeKnob->getValue()/volumeKnob->getMaximum() );
+    looper.setPan( curLoop, panKnob->getValue()/panKnob->getMaximum() );
+    //centre is normal speed, two octaves either way
+    double octaves = (speedKnob->getValue() - 5.0) / 2.5;
+    if( fabs( octaves ) < 0.04 ) octaves = 0.0;
+    looper.setSpeed( curLoop, (float)pow( 2.0, octaves ) );
 }
 void RangLoopComponent::updateControls(){
     
-    Loop* loop = looper(curLoop);
-    decayKnob->setValue( (1.f-loop->decay)*decayKnob->getMaximum(), false );
-    volumeKnob->setValue( loop->gain*volumeKnob->getMaximum()/3.f, false );
-    panKnob->setValue( loop->pan*panKnob->getMaximum(), false );
-    stackButton->setToggleState( loop->stacking, false);
-    reverseButton->setToggleState( loop->reversing, false);
+    const LoopMeter& m = looper.meter(curLoop);
+    decayKnob->setValue( (1.f-m.decay)*decayKnob->getMaximum(), false );
+    volumeKnob->setValue( m.gain*volumeKnob->getMaximum()/3.f, false );
+    panKnob->setValue( m.pan*panKnob->getMaximum(), false );
+    speedKnob->setValue( 5.0 + 2.5 * log( m.speed ) / log( 2.0 ), false );
+    stackButton->setToggleState( (m.flags & LoopMeter::Stacking) != 0, false);
+    reverseButton->setToggleState( (m.flags & LoopMeter::Reversing) != 0, false);
     
 }
 void RangLoopComponent::updatePlaybackSlider(){
-    Loop* loop = looper(curLoop);
-    if( loop->numSamples ){
+    if( looper.meter(curLoop).numSamples ){
         //float min = loop->b[0].rMin * slider->getMaximum() / loop->b[0].curSize;
         //float max = loop->b[0].rMax * slider->getMaximum() / loop->b[0].curSize;
         //float pos = loop->b[0].rPos * slider->getMaximum() / loop->b[0].curSize;
@@ -887,7 +913,7 @@ void RangLoopComponent::audioDeviceIOCallback (const float** inputChannelData,
    if (outputChannelData[i] != 0)
       zeromem (outputChannelData[i], sizeof (float) * numSamples);
     
-    looper.audioIO( (float**) inputChannelData, outputChannelData, numSamples );
+    looper.audioIO( (float**) inputChannelData, totalNumInputChannels, outputChannelData, totalNumOutputChannels, numSamples );
 
 	/*for(int i=0; i < loops.size(); i++ )
         if( i != curLoop ) loops[i]->audioIO( (float**)inputChannelData, (float**)outputChannelData, numSamples );
@@ -908,6 +934,10 @@ void RangLoopComponent::audioDeviceIOCallback (const float** inputChannelData,
 
 void RangLoopComponent::audioDeviceAboutToStart (AudioIODevice* device)
 {
+    looper.prepareToPlay( device->getCurrentSampleRate(), device->getCurrentBufferSizeSamples() );
+    //loops take as many channels as the device has inputs, from their next recording on
+    int inputs = device->getActiveInputChannels().countNumberOfSetBits();
+    for( int i=0; i < loopComps.size(); i++) looper.setChannels( i, jmax( 1, inputs ) );
     //audioSourcePlayer.audioDeviceAboutToStart (device);
   recorder->audioDeviceAboutToStart(device);
 }
@@ -941,6 +971,11 @@ void RangLoopComponent::focusOfChildComponentChanged (FocusChangeType cause){
   for( int i=0; i < loopComps.size(); i++)
     if(loopComps[i] == comp) switchLoop(i);
 }
+void RangLoopComponent::autosaveChosen (int result, RangLoopComponent* component, File autosave){
+  //the fresh autosave of this run is left empty, the next run deletes it
+  if( result && component && !component->session->load( autosave ) )
+    AlertWindow::showMessageBoxAsync( AlertWindow::WarningIcon, "Autosave", autosave.getFileName() + " could not be loaded" );
+}
 void RangLoopComponent::timerCallback(){
 
   /*for( int i=0; i < loops.size(); i++){
@@ -948,8 +983,25 @@ void RangLoopComponent::timerCallback(){
     //loopComps[i]->repaint();
   }*/
     looper.updateRMS();
+    for( int i=0; i < loopComps.size(); i++){
+        String tip = String( looper.memoryUsed(i) / (1024.0 * 1024.0), 1 ) + " MB";
+        LooperImportStatus status;
+        if( import->getStatus( i, status ) ){
+            if( status.busy ) tip = String( (int)(status.progress * 100.f) ) + "%, " + tip;
+            tip = status.name + ", peak " + String( Decibels::gainToDecibels( status.peak ), 1 ) + " dB, " + tip;
+        }
+        loopComps[i]->setTooltip( tip );
+    }
     updateControls();
     updatePlaybackSlider();
+    LooperExportReport report;
+    if( exporter->takeReport( report ) ){
+        String text = String( report.files ) + " loops, " + String( report.bytes / (1024.0 * 1024.0), 1 ) + " MB in "
+          + String( report.seconds, 2 ) + " s: " + String( report.bytes / (1024.0 * 1024.0) / jmax( report.seconds, 0.001 ), 1 ) + " MB/s, "
+          + String( report.audioSeconds / jmax( report.seconds, 0.001 ), 0 ) + "x realtime";
+        if( report.failed ) text += "\n" + String( report.failed ) + " could not be written";
+        AlertWindow::showMessageBoxAsync( report.failed ? AlertWindow::WarningIcon : AlertWindow::InfoIcon, "Export loops", text );
+    }
 
   repaint();
 	/*if( recordFileStream && !stackButton->getToggleState() ) {
@@ -32,6 +32,10 @@
 #include "Looper.h"
 
 class RangOSC;
+class LooperShared;
+class LooperSession;
+class LooperImport;
+class LooperExport;
 //[/Headers]
 
 #include "LoopComponent.h"
@@ -81,6 +85,7 @@ public:
 	void updatePlaytimeLabel();
     void timerCallback();
     void focusOfChildComponentChanged (FocusChangeType cause);
+    static void autosaveChosen (int result, RangLoopComponent* component, File autosave);
     //[/UserMethods]
 
     void paint (Graphics& g);
@@ -109,6 +114,10 @@ private:
 
     Looper looper;
     RangOSC *osc;
+    LooperShared *shared; //local controllers and meters without the udp round trip
+    LooperSession *session;
+    LooperImport *import; //audio files into loops as they decode
+    LooperExport *exporter;
     std::vector<LoopComponent*> loopComps;
     std::vector<Loop*> loops;
     int curLoop;
@@ -117,6 +126,7 @@ private:
     //AudioDeviceSelectorComponent* deviceSelector;
 
     ScopedPointer<AudioRecorder> recorder;
+    TooltipWindow tooltipWindow;
     //[/UserVariables]
 
     //==============================================================================
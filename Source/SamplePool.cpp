@@ -0,0 +1,46 @@
+
+#include "SamplePool.h"
+
+SamplePool::SamplePool( unsigned int numChunks_, unsigned int lowWatermark_ )
+  : Thread("SamplePool"), numChunks(numChunks_), lowWatermark(lowWatermark_), freeList(numChunks_) {
+  //address space only, pages are committed as the refill thread touches them
+  memory = numChunks > 0 ? new float[ (size_t)numChunks * LOOP_CHUNK_SIZE ] : 0;
+  refill( lowWatermark );
+  startThread(0);
+}
+
+SamplePool::~SamplePool(){
+  stopThread(1000);
+  if( memory ) delete[] memory;
+}
+
+float* SamplePool::allocate(){
+  float *chunk;
+  if( !freeList.pop(chunk) ) return 0;
+  --numFree;
+  return chunk;
+}
+
+void SamplePool::release( float *chunk ){
+  if( !owns( chunk ) ) return;
+  freeList.push(chunk);
+  ++numFree;
+}
+
+//carve fresh chunks off the arena until target are free, or the budget is spent.
+//only called from the constructor and the refill thread
+void SamplePool::refill( unsigned int target ){
+  while( numFree.get() < (int)target && numCarved.get() < (int)numChunks ){
+    float *chunk = memory + (size_t)numCarved.get() * LOOP_CHUNK_SIZE;
+    zeromem( chunk, LOOP_CHUNK_BYTES );
+    ++numCarved;
+    release(chunk);
+  }
+}
+
+void SamplePool::run(){
+  while( !threadShouldExit() ){
+    if( numFree.get() < (int)lowWatermark ) refill( 2 * lowWatermark );
+    wait(10);
+  }
+}
@@ -0,0 +1,48 @@
+
+#ifndef _SAMPLEPOOL_H_
+#define _SAMPLEPOOL_H_
+
+#include "LockFreeQueue.h"
+
+//loop storage is made of fixed size chunks, addressed by sample index
+#define LOOP_CHUNK_BITS 13
+#define LOOP_CHUNK_SIZE (1 << LOOP_CHUNK_BITS)
+#define LOOP_CHUNK_MASK (LOOP_CHUNK_SIZE - 1)
+#define LOOP_CHUNK_BYTES (LOOP_CHUNK_SIZE * sizeof(float))
+
+// sample memory arena, reserved once at startup from a fixed budget and handed
+// out in chunks of LOOP_CHUNK_SIZE floats. a low priority thread carves and
+// pre-faults chunks so the free list never drops below the low watermark;
+// allocate and release only touch the lock-free free list.
+class SamplePool : private Thread {
+public:
+
+  SamplePool( unsigned int numChunks, unsigned int lowWatermark );
+  ~SamplePool();
+
+  //returns 0 when no chunk is free
+  float* allocate();
+  //chunks from anywhere else, a mapped session file say, are let go of as they are
+  void release( float *chunk );
+  inline bool owns( const float *chunk ) const {
+    return chunk >= memory && chunk < memory + (size_t)numChunks * LOOP_CHUNK_SIZE;
+  }
+
+  unsigned int capacity() const { return numChunks; } //budget
+  unsigned int available() const { return numFree.get(); } //ready in the free list
+  unsigned int used() const { return numCarved.get() - numFree.get(); }
+
+private:
+  float *memory;
+  unsigned int numChunks, lowWatermark;
+  LockFreeQueue<float*> freeList;
+  Atomic<int> numFree, numCarved;
+
+  void run();
+  void refill( unsigned int target );
+
+  SamplePool( const SamplePool& );
+  SamplePool& operator=( const SamplePool& );
+};
+
+#endif
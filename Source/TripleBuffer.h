@@ -0,0 +1,41 @@
+
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// latest value handoff from one writer thread to one reader thread.
+// the writer fills write() and publish()es it, the reader picks up the
+// newest published copy with read(). neither side ever waits, and the
+// reader always sees a complete value, possibly skipping some in between.
+template <typename T>
+class TripleBuffer {
+public:
+
+  TripleBuffer() : front(0), back(2) { middle.set(1); }
+
+  //writer side
+  T& write(){ return buffers[back]; }
+  void publish(){ back = middle.exchange( back | fresh ) & index; }
+
+  //reader side, swaps in the last published value if there is a newer one
+  const T& read(){
+    if( middle.get() & fresh ) front = middle.exchange( front ) & index;
+    return buffers[front];
+  }
+
+private:
+  enum { index = 3, fresh = 4 };
+
+  T buffers[3];
+  int front;
+  char pad0[64];
+  Atomic<int> middle;
+  char pad1[64];
+  int back;
+
+  TripleBuffer( const TripleBuffer& );
+  TripleBuffer& operator=( const TripleBuffer& );
+};
+
+#endif
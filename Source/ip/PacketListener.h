@@ -38,6 +38,15 @@ public:
     virtual ~PacketListener() {}
     virtual void ProcessPacket( const char *data, int size, 
 			const IpEndpointName& remoteEndpoint ) = 0;
+
+    // arrival is when the kernel received the packet, in seconds since
+    // the unix epoch, or 0 where the socket layer can't tell
+    virtual void ProcessPacket( const char *data, int size, 
+			const IpEndpointName& remoteEndpoint, double arrival )
+    {
+        (void) arrival;
+        ProcessPacket( data, size, remoteEndpoint );
+    }
 };
 
 #endif /* INCLUDED_PACKETLISTENER_H */
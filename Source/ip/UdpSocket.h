@@ -101,13 +101,26 @@ public:
 	void Send( const char *data, int size );
     void SendTo( const IpEndpointName& remoteEndpoint, const char *data, int size );
 
+	// send count datagrams, data[i] of sizes[i] bytes to remoteEndpoints[i],
+	// batched into few system calls where sendmmsg is available. returns
+	// the number handed to the network. unlike SendTo, several threads
+	// may call it at the same time
+	int SendMany( const IpEndpointName *remoteEndpoints, const char *const *data, const int *sizes, int count );
+
+	// hops datagrams sent to a multicast group may travel, and whether
+	// they are also delivered back to this host. throws
+	// std::runtime_error if the options can't be set
+	void SetMulticast( int timeToLive, bool loopback );
+
 
 	// Bind a local endpoint to receive incoming data. Endpoint
 	// can be 'any' for the system to choose an endpoint
 	void Bind( const IpEndpointName& localEndpoint );
 	bool IsBound() const;
 
-	int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size );
+	// arrival, if given, gets the kernel receive time as for
+	// PacketListener::ProcessPacket
+	int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size, double *arrival = 0 );
 };
 
 
@@ -46,8 +46,16 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
 #include <netinet/in.h> // for sockaddr_in
 
+// linux takes either width for the multicast options, the bsds only a byte
+typedef unsigned char MULTICAST_OPTION;
+
 #include "../PacketListener.h"
 #include "../TimerListener.h"
 
@@ -88,6 +96,31 @@ static IpEndpointName IpEndpointNameFromSockaddr( const struct sockaddr_in& sock
 }
 
 
+// kernel receive time from the control messages of a recvmsg, 0 if there is none
+static double ArrivalFromControl( struct msghdr& msg )
+{
+	double arrival = 0.;
+	for( struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c) ){
+		if( c->cmsg_level != SOL_SOCKET )
+			continue;
+#if defined(SO_TIMESTAMPNS)
+		if( c->cmsg_type == SCM_TIMESTAMPNS ){
+			struct timespec ts;
+			memcpy( &ts, CMSG_DATA(c), sizeof(ts) );
+			arrival = ts.tv_sec + ts.tv_nsec * 1e-9;
+		}
+#elif defined(SO_TIMESTAMP)
+		if( c->cmsg_type == SCM_TIMESTAMP ){
+			struct timeval tv;
+			memcpy( &tv, CMSG_DATA(c), sizeof(tv) );
+			arrival = tv.tv_sec + tv.tv_usec * 1e-6;
+		}
+#endif
+	}
+	return arrival;
+}
+
+
 class UdpSocket::Implementation{
 	bool isBound_;
 	bool isConnected_;
@@ -107,6 +140,15 @@ public:
             throw std::runtime_error("unable to create udp socket\n");
         }
 
+		// have the kernel stamp packets on arrival, ReceiveFrom picks it up.
+		// nanoseconds where there are, microseconds otherwise
+		int on = 1;
+#if defined(SO_TIMESTAMPNS)
+		setsockopt( socket_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on) );
+#elif defined(SO_TIMESTAMP)
+		setsockopt( socket_, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on) );
+#endif
+
 		memset( &sendToAddr_, 0, sizeof(sendToAddr_) );
         sendToAddr_.sin_family = AF_INET;
 	}
@@ -187,6 +229,51 @@ public:
         sendto( socket_, data, size, 0, (sockaddr*)&sendToAddr_, sizeof(sendToAddr_) );
 	}
 
+	int SendMany( const IpEndpointName *remoteEndpoints, const char *const *data, const int *sizes, int count )
+	{
+#if defined(__linux__)
+		const int BATCH = 64;
+		struct mmsghdr messages[ BATCH ];
+		struct iovec iov[ BATCH ];
+		struct sockaddr_in to[ BATCH ];
+
+		// a datagram the kernel refuses, say after an icmp error from a client
+		// that went away, is skipped so the rest still go
+		int sent = 0, handed = 0;
+		while( sent < count ){
+			int n = count - sent < BATCH ? count - sent : BATCH;
+			memset( messages, 0, n * sizeof(struct mmsghdr) );
+			for( int i = 0; i < n; ++i ){
+				SockaddrFromIpEndpointName( to[i], remoteEndpoints[sent + i] );
+				iov[i].iov_base = const_cast<char*>( data[sent + i] );
+				iov[i].iov_len = sizes[sent + i];
+				messages[i].msg_hdr.msg_name = &to[i];
+				messages[i].msg_hdr.msg_namelen = sizeof(to[i]);
+				messages[i].msg_hdr.msg_iov = &iov[i];
+				messages[i].msg_hdr.msg_iovlen = 1;
+			}
+			int result = sendmmsg( socket_, messages, n, 0 );
+			if( result <= 0 ){
+				++sent;
+				continue;
+			}
+			sent += result;
+			handed += result;
+		}
+		return handed;
+#else
+		// no shared address member, threads may send side by side
+		int handed = 0;
+		for( int i = 0; i < count; ++i ){
+			struct sockaddr_in to;
+			SockaddrFromIpEndpointName( to, remoteEndpoints[i] );
+			if( sendto( socket_, data[i], sizes[i], 0, (sockaddr*)&to, sizeof(to) ) >= 0 )
+				++handed;
+		}
+		return handed;
+#endif
+	}
+
 	void Bind( const IpEndpointName& localEndpoint )
 	{
 		struct sockaddr_in bindSockAddr;
@@ -201,21 +288,46 @@ public:
 
 	bool IsBound() const { return isBound_; }
 
-    int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
+	void SetMulticast( int timeToLive, bool loopback )
+	{
+		MULTICAST_OPTION ttl = (MULTICAST_OPTION)timeToLive;
+		MULTICAST_OPTION loop = loopback ? 1 : 0;
+		if( setsockopt( socket_, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl) ) < 0
+				|| setsockopt( socket_, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop) ) < 0 ){
+			throw std::runtime_error("unable to set multicast options on udp socket\n");
+		}
+	}
+
+    int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size, double *arrival )
 	{
 		assert( isBound_ );
 
 		struct sockaddr_in fromAddr;
-        socklen_t fromAddrLen = sizeof(fromAddr);
-             	 
-        int result = recvfrom(socket_, data, size, 0,
-                    (struct sockaddr *) &fromAddr, (socklen_t*)&fromAddrLen);
+		struct iovec iov;
+		iov.iov_base = data;
+		iov.iov_len = size;
+
+		// room for the timestamp control message, aligned for the headers in it
+		union{ struct cmsghdr header; char bytes[ 128 ]; } control;
+		struct msghdr msg;
+		memset( &msg, 0, sizeof(msg) );
+		msg.msg_name = &fromAddr;
+		msg.msg_namelen = sizeof(fromAddr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.bytes;
+		msg.msg_controllen = sizeof(control.bytes);
+
+        int result = recvmsg(socket_, &msg, 0);
 		if( result < 0 )
 			return 0;
 
 		remoteEndpoint.address = ntohl(fromAddr.sin_addr.s_addr);
 		remoteEndpoint.port = ntohs(fromAddr.sin_port);
 
+		if( arrival )
+			*arrival = ArrivalFromControl( msg );
+
 		return result;
 	}
 
@@ -252,6 +364,11 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+int UdpSocket::SendMany( const IpEndpointName *remoteEndpoints, const char *const *data, const int *sizes, int count )
+{
+	return impl_->SendMany( remoteEndpoints, data, sizes, count );
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
@@ -262,9 +379,14 @@ bool UdpSocket::IsBound() const
 	return impl_->IsBound();
 }
 
-int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
+void UdpSocket::SetMulticast( int timeToLive, bool loopback )
 {
-	return impl_->ReceiveFrom( remoteEndpoint, data, size );
+	impl_->SetMulticast( timeToLive, loopback );
+}
+
+int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size, double *arrival )
+{
+	return impl_->ReceiveFrom( remoteEndpoint, data, size, arrival );
 }
 
 
@@ -279,13 +401,65 @@ struct AttachedTimerListener{
 };
 
 
+// heap order, the soonest call ends up on top
 static bool CompareScheduledTimerCalls( 
 		const std::pair< double, AttachedTimerListener > & lhs, const std::pair< double, AttachedTimerListener > & rhs )
 {
-	return lhs.first < rhs.first;
+	return lhs.first > rhs.first;
 }
 
 
+#if defined(__linux__)
+// datagrams for one recvmmsg, allocated once per Run
+struct PacketRing{
+	enum { SIZE = 64, MAX_PACKET_SIZE = 4098, CONTROL_SIZE = 128 };
+
+	char *memory;
+	char *data[ SIZE ];
+	struct mmsghdr messages[ SIZE ];
+	struct iovec iov[ SIZE ];
+	struct sockaddr_in from[ SIZE ];
+	union{ struct cmsghdr header; char bytes[ CONTROL_SIZE ]; } control[ SIZE ];
+
+	PacketRing()
+	{
+		memory = new char[ SIZE * MAX_PACKET_SIZE ];
+		memset( messages, 0, sizeof(messages) );
+		for( int i = 0; i < SIZE; ++i ){
+			data[i] = memory + i * MAX_PACKET_SIZE;
+			iov[i].iov_base = data[i];
+			iov[i].iov_len = MAX_PACKET_SIZE;
+			messages[i].msg_hdr.msg_name = &from[i];
+			messages[i].msg_hdr.msg_iov = &iov[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_control = control[i].bytes;
+		}
+	}
+
+	~PacketRing()
+	{
+		delete [] memory;
+	}
+
+	// as many waiting datagrams as fit, without blocking. returns how many
+	int Receive( int socket )
+	{
+		// the kernel shortens these to what it filled in
+		for( int i = 0; i < SIZE; ++i ){
+			messages[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			messages[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+		}
+		int n = recvmmsg( socket, messages, SIZE, MSG_DONTWAIT, 0 );
+		return n < 0 ? 0 : n;
+	}
+
+private:
+	PacketRing( const PacketRing& );
+	PacketRing& operator=( const PacketRing& );
+};
+#endif
+
+
 SocketReceiveMultiplexer *multiplexerInstanceToAbortWithSigInt_ = 0;
 
 extern "C" /*static*/ void InterruptSignalHandler( int );
@@ -365,10 +539,118 @@ public:
 		timerListeners_.erase( i );
 	}
 
-    void Run()
+	// timers are kept in a binary heap on expiry time, soonest on top
+	typedef std::pair< double, AttachedTimerListener > ScheduledTimerCall;
+
+	void ScheduleTimers( std::vector< ScheduledTimerCall >& timerQueue )
 	{
-		break_ = false;
+		double currentTimeMs = GetCurrentTimeMs();
+		for( std::vector< AttachedTimerListener >::iterator i = timerListeners_.begin();
+				i != timerListeners_.end(); ++i )
+			timerQueue.push_back( std::make_pair( currentTimeMs + i->initialDelayMs, *i ) );
+		std::make_heap( timerQueue.begin(), timerQueue.end(), CompareScheduledTimerCalls );
+	}
 
+	// milliseconds until the next timer is due, -1 if there are none
+	double TimeoutMs( const std::vector< ScheduledTimerCall >& timerQueue ) const
+	{
+		if( timerQueue.empty() )
+			return -1.;
+		double timeoutMs = timerQueue.front().first - GetCurrentTimeMs();
+		return timeoutMs < 0 ? 0. : timeoutMs;
+	}
+
+	// each timer that is due fires once, then goes back in at its next period
+	void ExecuteExpiredTimers( std::vector< ScheduledTimerCall >& timerQueue )
+	{
+		double currentTimeMs = GetCurrentTimeMs();
+		for( size_t n = timerQueue.size(); n > 0 && timerQueue.front().first <= currentTimeMs; --n ){
+			std::pop_heap( timerQueue.begin(), timerQueue.end(), CompareScheduledTimerCalls );
+			ScheduledTimerCall& call = timerQueue.back();
+
+			call.second.listener->TimerExpired();
+			call.first += call.second.periodMs;
+			std::push_heap( timerQueue.begin(), timerQueue.end(), CompareScheduledTimerCalls );
+			if( break_ )
+				break;
+		}
+	}
+
+	void ClearBreakPipe()
+	{
+		// clear pending data from the asynchronous break pipe
+		char c;
+		read( breakPipe_[0], &c, 1 );
+	}
+
+#if defined(__linux__)
+	// one epoll_wait per wakeup, and each ready socket drained with recvmmsg
+	// into a ring of preallocated packets, so a burst costs a syscall or two
+	void RunEpoll( std::vector< ScheduledTimerCall >& timerQueue )
+	{
+		int epollfd = epoll_create( (int)socketListeners_.size() + 1 );
+		if( epollfd < 0 )
+			throw std::runtime_error("epoll_create failed\n");
+
+		// events carry the listener index, the break pipe is one past the end
+		struct epoll_event ev;
+		memset( &ev, 0, sizeof(ev) );
+		ev.events = EPOLLIN;
+		ev.data.u32 = (uint32_t)socketListeners_.size();
+		bool added = epoll_ctl( epollfd, EPOLL_CTL_ADD, breakPipe_[0], &ev ) == 0;
+		for( size_t i = 0; i < socketListeners_.size() && added; ++i ){
+			ev.data.u32 = (uint32_t)i;
+			added = epoll_ctl( epollfd, EPOLL_CTL_ADD, socketListeners_[i].second->impl_->Socket(), &ev ) == 0;
+		}
+		if( !added ){
+			close( epollfd );
+			throw std::runtime_error("epoll_ctl failed\n");
+		}
+
+		PacketRing ring;
+		std::vector< struct epoll_event > ready( socketListeners_.size() + 1 );
+
+		while( !break_ ){
+			double timeoutMs = TimeoutMs( timerQueue );
+			int n = epoll_wait( epollfd, &ready[0], (int)ready.size(), timeoutMs < 0 ? -1 : (int)ceil( timeoutMs ) );
+			if( n < 0 && errno != EINTR ){
+				close( epollfd );
+				throw std::runtime_error("epoll_wait failed\n");
+			}
+
+			for( int e = 0; e < n && !break_; ++e ){
+				uint32_t index = ready[e].data.u32;
+				if( index == socketListeners_.size() ){
+					ClearBreakPipe();
+					continue;
+				}
+				PacketListener *listener = socketListeners_[index].first;
+				int socket = socketListeners_[index].second->impl_->Socket();
+
+				// a short batch means the socket is empty
+				int received;
+				do{
+					received = ring.Receive( socket );
+					for( int p = 0; p < received && !break_; ++p ){
+						IpEndpointName remoteEndpoint( ntohl( ring.from[p].sin_addr.s_addr ), ntohs( ring.from[p].sin_port ) );
+						listener->ProcessPacket( ring.data[p], ring.messages[p].msg_len, remoteEndpoint,
+								ArrivalFromControl( ring.messages[p].msg_hdr ) );
+					}
+				}while( received == PacketRing::SIZE && !break_ );
+			}
+
+			if( break_ )
+				break;
+
+			ExecuteExpiredTimers( timerQueue );
+		}
+
+		close( epollfd );
+	}
+#endif
+
+	void RunSelect( std::vector< ScheduledTimerCall >& timerQueue )
+	{
 		// configure the master fd_set for select()
 
 		fd_set masterfds, tempfds;
@@ -389,20 +671,10 @@ public:
 			FD_SET( i->second->impl_->Socket(), &masterfds );
 		}
 
-
-		// configure the timer queue
-		double currentTimeMs = GetCurrentTimeMs();
-
-		// expiry time ms, listener
-		std::vector< std::pair< double, AttachedTimerListener > > timerQueue_;
-		for( std::vector< AttachedTimerListener >::iterator i = timerListeners_.begin();
-				i != timerListeners_.end(); ++i )
-			timerQueue_.push_back( std::make_pair( currentTimeMs + i->initialDelayMs, *i ) );
-		std::sort( timerQueue_.begin(), timerQueue_.end(), CompareScheduledTimerCalls );
-
 		const int MAX_BUFFER_SIZE = 4098;
 		char *data = new char[ MAX_BUFFER_SIZE ];
 		IpEndpointName remoteEndpoint;
+		double arrival;
 
 		struct timeval timeout;
 
@@ -410,11 +682,8 @@ public:
 			tempfds = masterfds;
 
 			struct timeval *timeoutPtr = 0;
-			if( !timerQueue_.empty() ){
-				double timeoutMs = timerQueue_.front().first - GetCurrentTimeMs();
-				if( timeoutMs < 0 )
-					timeoutMs = 0;
-			
+			double timeoutMs = TimeoutMs( timerQueue );
+			if( timeoutMs >= 0 ){
 				// 1000000 microseconds in a second
 				timeout.tv_sec = (long)(timeoutMs * .001);
 				timeout.tv_usec = (long)((timeoutMs - (timeout.tv_sec * 1000)) * 1000);
@@ -422,14 +691,12 @@ public:
 			}
 
 			if( select( fdmax + 1, &tempfds, 0, 0, timeoutPtr ) < 0 && errno != EINTR ){
+				delete [] data;
    				throw std::runtime_error("select failed\n");
 			}
 
-			if ( FD_ISSET( breakPipe_[0], &tempfds ) ){
-				// clear pending data from the asynchronous break pipe
-				char c;
-				read( breakPipe_[0], &c, 1 );
-			}
+			if ( FD_ISSET( breakPipe_[0], &tempfds ) )
+				ClearBreakPipe();
 			
 			if( break_ )
 				break;
@@ -439,35 +706,38 @@ public:
 
 				if( FD_ISSET( i->second->impl_->Socket(), &tempfds ) ){
 
-					int size = i->second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE );
+					int size = i->second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE, &arrival );
 					if( size > 0 ){
-						i->first->ProcessPacket( data, size, remoteEndpoint );
+						i->first->ProcessPacket( data, size, remoteEndpoint, arrival );
 						if( break_ )
 							break;
 					}
 				}
 			}
 
-			// execute any expired timers
-			currentTimeMs = GetCurrentTimeMs();
-			bool resort = false;
-			for( std::vector< std::pair< double, AttachedTimerListener > >::iterator i = timerQueue_.begin();
-					i != timerQueue_.end() && i->first <= currentTimeMs; ++i ){
-
-				i->second.listener->TimerExpired();
-				if( break_ )
-					break;
+			if( break_ )
+				break;
 
-				i->first += i->second.periodMs;
-				resort = true;
-			}
-			if( resort )
-				std::sort( timerQueue_.begin(), timerQueue_.end(), CompareScheduledTimerCalls );
+			ExecuteExpiredTimers( timerQueue );
 		}
 
 		delete [] data;
 	}
 
+    void Run()
+	{
+		break_ = false;
+
+		std::vector< ScheduledTimerCall > timerQueue;
+		ScheduleTimers( timerQueue );
+
+#if defined(__linux__)
+		RunEpoll( timerQueue );
+#else
+		RunSelect( timerQueue );
+#endif
+	}
+
     void Break()
 	{
 		break_ = true;
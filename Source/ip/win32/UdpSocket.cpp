@@ -30,6 +30,7 @@
 #include "ip/UdpSocket.h"
 
 #include <winsock2.h>   // this must come first to prevent errors with MSVC7
+#include <ws2tcpip.h>   // for IP_MULTICAST_TTL
 #include <windows.h>
 #include <mmsystem.h>   // for timeGetTime()
 
@@ -43,6 +44,9 @@
 #include "ip/PacketListener.h"
 #include "ip/TimerListener.h"
 
+// winsock takes the multicast options as DWORDs
+typedef DWORD MULTICAST_OPTION;
+
 
 typedef int socklen_t;
 
@@ -191,10 +195,24 @@ public:
 
 	bool IsBound() const { return isBound_; }
 
-    int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
+	void SetMulticast( int timeToLive, bool loopback )
+	{
+		MULTICAST_OPTION ttl = (MULTICAST_OPTION)timeToLive;
+		MULTICAST_OPTION loop = loopback ? 1 : 0;
+		if( setsockopt( socket_, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl) ) < 0
+				|| setsockopt( socket_, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop) ) < 0 ){
+			throw std::runtime_error("unable to set multicast options on udp socket\n");
+		}
+	}
+
+    int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size, double *arrival )
 	{
 		assert( isBound_ );
 
+		// no receive timestamps here
+		if( arrival )
+			*arrival = 0.;
+
 		struct sockaddr_in fromAddr;
         socklen_t fromAddrLen = sizeof(fromAddr);
              	 
@@ -242,6 +260,19 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+int UdpSocket::SendMany( const IpEndpointName *remoteEndpoints, const char *const *data, const int *sizes, int count )
+{
+	// no shared address member, threads may send side by side
+	int handed = 0;
+	for( int i = 0; i < count; ++i ){
+		struct sockaddr_in to;
+		SockaddrFromIpEndpointName( to, remoteEndpoints[i] );
+		if( sendto( impl_->Socket(), data[i], sizes[i], 0, (sockaddr*)&to, sizeof(to) ) != SOCKET_ERROR )
+			++handed;
+	}
+	return handed;
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
@@ -252,9 +283,14 @@ bool UdpSocket::IsBound() const
 	return impl_->IsBound();
 }
 
-int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
+void UdpSocket::SetMulticast( int timeToLive, bool loopback )
+{
+	impl_->SetMulticast( timeToLive, loopback );
+}
+
+int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size, double *arrival )
 {
-	return impl_->ReceiveFrom( remoteEndpoint, data, size );
+	return impl_->ReceiveFrom( remoteEndpoint, data, size, arrival );
 }
 
 
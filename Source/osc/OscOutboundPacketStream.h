@@ -96,7 +96,7 @@ public:
     OutboundPacketStream& operator<<( const InfinitumType& rhs );
     OutboundPacketStream& operator<<( int32 rhs );
 
-#ifndef x86_64
+#if !defined(x86_64) && !defined(__x86_64__) && !defined(__LP64__)
     OutboundPacketStream& operator<<( int rhs )
             { *this << (int32)rhs; return *this; }
 #endif
@@ -49,7 +49,7 @@ typedef unsigned long long uint64;
 
 
 
-#ifdef x86_64
+#if defined(x86_64) || defined(__x86_64__) || defined(__LP64__)
 
 typedef signed int int32;
 typedef unsigned int uint32;